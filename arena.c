@@ -0,0 +1,118 @@
+/*    arena.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of arena.[h|c] is to store a large number of C strings
+ * without ever moving them. See arena.h.
+ * */
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#define HUGEPAGE (2 * 1024 * 1024)
+
+static achunk_t
+*new_chunk(arena_t *a, size_t need);
+
+arena_t
+*arena_init(int hugepages)
+{ /* make an empty arena; no memory is mapped until the first string. */
+  arena_t *a = xcalloc(1, sizeof(struct arena_t));
+  a->next_size = ARENA_MINCHUNK;
+  a->hugepages = hugepages;
+  return a;
+} // arena_init()
+
+void
+arena_free(arena_t *a)
+{ /* unmap all chunks and the arena itself. */
+  if (!a) return;
+  achunk_t *c = a->first;
+  while (c) {
+    achunk_t *next = c->next;
+    munmap(c, c->size);
+    c = next;
+  }
+  free(a);
+} // arena_free()
+
+static achunk_t
+*new_chunk(arena_t *a, size_t need)
+{ /* map the next chunk, big enough for need bytes of data. */
+  size_t size = a->next_size;
+  while (size < need + sizeof(achunk_t)) size *= 2;
+  /* For huge pages the chunk must be aligned to one, so map a huge
+   * page more than needed and trim the ends off. */
+  size_t slack = 0;
+  if (a->hugepages) {
+    size = (size + HUGEPAGE - 1) & ~((size_t)HUGEPAGE - 1);
+    slack = HUGEPAGE;
+  }
+  char *p = mmap(NULL, size + slack, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  if (slack) {
+    char *al = (char *)(((uintptr_t)p + HUGEPAGE - 1)
+                        & ~((uintptr_t)HUGEPAGE - 1));
+    if (al > p) munmap(p, al - p);
+    if (p + slack > al) munmap(al + size, p + slack - al);
+    p = al;
+    madvise(p, size, MADV_HUGEPAGE); // advice only, failure is harmless.
+  }
+  achunk_t *c = (achunk_t *)p;
+  c->next = NULL;
+  c->size = size;
+  c->to = p + sizeof(achunk_t);
+  c->limit = p + size;
+  if (a->last) {
+    a->last->next = c;
+  } else {
+    a->first = c;
+  }
+  a->last = c;
+  a->nchunks++;
+  a->mapped += size;
+  if (a->next_size < ARENA_MAXCHUNK) a->next_size *= 2;
+  return c;
+} // new_chunk()
+
+char
+*arena_strdup(arena_t *a, const char *s)
+{ /* copy s into the arena and return where it is kept. */
+  size_t len = strlen(s) + 1;
+  achunk_t *c = a->last;
+  if (!c || (size_t)(c->limit - c->to) < len) c = new_chunk(a, len);
+  char *ret = c->to;
+  memcpy(ret, s, len);
+  c->to += len;
+  a->used += len;
+  return ret;
+} // arena_strdup()
+
+void
+arena_report(arena_t *a, const char *what)
+{ /* tell the user how much memory the arena is using. */
+  fprintf(stderr, "%s: %lu bytes used in %d chunks of %lu bytes mapped"
+          "%s.\n", what, a->used, a->nchunks, a->mapped,
+          (a->hugepages) ? ", huge pages requested" : "");
+} // arena_report()
@@ -0,0 +1,69 @@
+/*    arena.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of arena.[h|c] is to store a large number of C strings
+ * in a list of mmap()ed chunks. A chunk is never moved or resized, so
+ * a pointer to a stored string stays good until arena_free(). Each new
+ * chunk is twice the size of the one before, up to ARENA_MAXCHUNK, so
+ * there is nothing to tune whatever the number of strings.
+ * */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include "str.h"
+
+#define ARENA_MINCHUNK (1024 * 1024)
+#define ARENA_MAXCHUNK (256 * 1024 * 1024)
+
+typedef struct achunk_t {
+  struct achunk_t *next;
+  size_t size;  // bytes mapped, including this header.
+  char *to;     // the next free byte.
+  char *limit;  // one past the last usable byte.
+} achunk_t;
+
+typedef struct arena_t {
+  achunk_t *first;
+  achunk_t *last;
+  size_t next_size; // size of the next chunk to map.
+  int hugepages;    // ask for transparent huge pages.
+  int nchunks;
+  size_t used;      // bytes of string data, including the '\0's.
+  size_t mapped;    // bytes mapped in all chunks.
+} arena_t;
+
+arena_t
+*arena_init(int hugepages);
+
+void
+arena_free(arena_t *a);
+
+char
+*arena_strdup(arena_t *a, const char *s);
+
+void
+arena_report(arena_t *a, const char *what);
+
+#endif
@@ -0,0 +1,223 @@
+/*    blake3.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of blake3.[h|c] is to compute BLAKE3 digests. See
+ * blake3.h.
+ * */
+
+#include "blake3.h"
+
+#define CHUNK_START 1
+#define CHUNK_END 2
+#define PARENT 4
+#define ROOT 8
+
+static const uint32_t IV[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t PERM[16] = {
+  2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8
+};
+
+typedef struct b3out_t {  // all that is needed to finish a node.
+  uint32_t cv[8];
+  uint32_t m[16];
+  uint64_t counter;
+  uint32_t block_len;
+  uint32_t flags;
+} b3out_t;
+
+static void
+compress(const uint32_t *cv, const uint32_t *m, uint64_t counter,
+         uint32_t block_len, uint32_t flags, uint32_t *out);
+static void
+words(const uint8_t *bytes, uint32_t *m);
+static void
+chunk_init(b3chunk_t *c, uint64_t counter);
+static void
+chunk_output(const b3chunk_t *c, b3out_t *o);
+static void
+parent_output(const uint32_t *left, const uint32_t *right, b3out_t *o);
+static void
+output_cv(const b3out_t *o, uint32_t *cv);
+
+static inline uint32_t
+rotr(uint32_t w, int c)
+{ /* rotate right. */
+  return (w >> c) | (w << (32 - c));
+} // rotr()
+
+#define G(a, b, c, d, x, y) do {                                       \
+  s[a] = s[a] + s[b] + (x); s[d] = rotr(s[d] ^ s[a], 16);              \
+  s[c] = s[c] + s[d];       s[b] = rotr(s[b] ^ s[c], 12);              \
+  s[a] = s[a] + s[b] + (y); s[d] = rotr(s[d] ^ s[a], 8);               \
+  s[c] = s[c] + s[d];       s[b] = rotr(s[b] ^ s[c], 7);               \
+} while (0)
+
+static void
+compress(const uint32_t *cv, const uint32_t *m, uint64_t counter,
+         uint32_t block_len, uint32_t flags, uint32_t *out)
+{ /* The compression function; out gets all 16 words of the state,
+   * the first 8 being the new chaining value.
+  */
+  uint32_t s[16] = {
+    cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+    IV[0], IV[1], IV[2], IV[3],
+    (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags
+  };
+  uint32_t w[16], t[16];
+  memcpy(w, m, sizeof(w));
+  int r, i;
+  for (r = 0; r < 7; r++) {
+    G(0, 4, 8, 12, w[0], w[1]);
+    G(1, 5, 9, 13, w[2], w[3]);
+    G(2, 6, 10, 14, w[4], w[5]);
+    G(3, 7, 11, 15, w[6], w[7]);
+    G(0, 5, 10, 15, w[8], w[9]);
+    G(1, 6, 11, 12, w[10], w[11]);
+    G(2, 7, 8, 13, w[12], w[13]);
+    G(3, 4, 9, 14, w[14], w[15]);
+    for (i = 0; i < 16; i++) t[i] = w[PERM[i]];
+    memcpy(w, t, sizeof(w));
+  }
+  for (i = 0; i < 8; i++) {
+    out[i] = s[i] ^ s[i + 8];
+    out[i + 8] = s[i + 8] ^ cv[i];
+  }
+} // compress()
+
+static void
+words(const uint8_t *bytes, uint32_t *m)
+{ /* a block as 16 little endian words. */
+  int i;
+  for (i = 0; i < 16; i++) {
+    m[i] = (uint32_t)bytes[4 * i] | (uint32_t)bytes[4 * i + 1] << 8 |
+           (uint32_t)bytes[4 * i + 2] << 16 | (uint32_t)bytes[4 * i + 3] << 24;
+  }
+} // words()
+
+static void
+chunk_init(b3chunk_t *c, uint64_t counter)
+{ /* an empty chunk. */
+  memset(c, 0, sizeof(struct b3chunk_t));
+  memcpy(c->cv, IV, sizeof(IV));
+  c->counter = counter;
+} // chunk_init()
+
+static void
+chunk_output(const b3chunk_t *c, b3out_t *o)
+{ /* the last block of a chunk, not yet compressed. */
+  uint8_t block[BLAKE3_BLOCK_LEN] = {0};
+  memcpy(block, c->block, c->block_len);
+  memcpy(o->cv, c->cv, sizeof(o->cv));
+  words(block, o->m);
+  o->counter = c->counter;
+  o->block_len = c->block_len;
+  o->flags = CHUNK_END | ((c->blocks == 0) ? CHUNK_START : 0);
+} // chunk_output()
+
+static void
+parent_output(const uint32_t *left, const uint32_t *right, b3out_t *o)
+{ /* a parent node over two chaining values. */
+  memcpy(o->cv, IV, sizeof(IV));
+  memcpy(o->m, left, 8 * sizeof(uint32_t));
+  memcpy(o->m + 8, right, 8 * sizeof(uint32_t));
+  o->counter = 0;
+  o->block_len = BLAKE3_BLOCK_LEN;
+  o->flags = PARENT;
+} // parent_output()
+
+static void
+output_cv(const b3out_t *o, uint32_t *cv)
+{ /* the chaining value of a node that is not the root. */
+  uint32_t out[16];
+  compress(o->cv, o->m, o->counter, o->block_len, o->flags, out);
+  memcpy(cv, out, 8 * sizeof(uint32_t));
+} // output_cv()
+
+void
+blake3_init(blake3_t *b)
+{ /* ready for input. */
+  chunk_init(&b->chunk, 0);
+  b->depth = 0;
+} // blake3_init()
+
+void
+blake3_update(blake3_t *b, const void *p, size_t n)
+{ /* Add n bytes. A full block, or chunk, is only compressed once more
+   * input arrives, since the last of each is finished differently.
+  */
+  const uint8_t *in = p;
+  while (n) {
+    b3chunk_t *c = &b->chunk;
+    if (c->blocks * BLAKE3_BLOCK_LEN + c->block_len == BLAKE3_CHUNK_LEN) {
+      b3out_t o;
+      uint32_t cv[8];
+      chunk_output(c, &o);
+      output_cv(&o, cv);
+      /* Merge completed subtrees; there is one for each trailing zero
+       * bit of the count of chunks done. */
+      uint64_t total = c->counter + 1;
+      while ((total & 1) == 0) {
+        parent_output(b->stack[--b->depth], cv, &o);
+        output_cv(&o, cv);
+        total >>= 1;
+      }
+      memcpy(b->stack[b->depth++], cv, sizeof(cv));
+      chunk_init(c, c->counter + 1);
+    }
+    if (c->block_len == BLAKE3_BLOCK_LEN) {
+      uint32_t m[16], out[16];
+      words(c->block, m);
+      compress(c->cv, m, c->counter, BLAKE3_BLOCK_LEN,
+               (c->blocks == 0) ? CHUNK_START : 0, out);
+      memcpy(c->cv, out, sizeof(c->cv));
+      c->blocks++;
+      c->block_len = 0;
+    }
+    size_t take = BLAKE3_BLOCK_LEN - c->block_len;
+    if (take > n) take = n;
+    memcpy(c->block + c->block_len, in, take);
+    c->block_len += take;
+    in += take;
+    n -= take;
+  } // while()
+} // blake3_update()
+
+void
+blake3_final(const blake3_t *b, unsigned char *out, size_t len)
+{ /* The first len bytes, at most 64, of the digest. The subtrees left
+   * on the stack are joined right to left; the last node is the root.
+  */
+  b3out_t o;
+  chunk_output(&b->chunk, &o);
+  int d = b->depth;
+  while (d > 0) {
+    uint32_t cv[8];
+    output_cv(&o, cv);
+    parent_output(b->stack[--d], cv, &o);
+  }
+  uint32_t w[16];
+  compress(o.cv, o.m, 0, o.block_len, o.flags | ROOT, w);
+  size_t i;
+  for (i = 0; i < len && i < 64; i++) out[i] = w[i / 4] >> (8 * (i % 4));
+} // blake3_final()
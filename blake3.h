@@ -0,0 +1,60 @@
+/*    blake3.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of blake3.[h|c] is to compute BLAKE3 digests, written
+ * from the BLAKE3 specification in portable C: the hash mode only, no
+ * keyed or key derivation modes, and no SIMD, chunks are compressed one
+ * at a time. Input may be fed in pieces of any size.
+ * */
+
+#ifndef _BLAKE3_H
+#define _BLAKE3_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_MAX_DEPTH 54   // subtree levels of 2^64 bytes of input.
+
+typedef struct b3chunk_t {
+  uint32_t cv[8];
+  uint64_t counter;           // index of this chunk in the input.
+  uint8_t block[BLAKE3_BLOCK_LEN];
+  uint8_t block_len;
+  uint8_t blocks;             // blocks compressed so far.
+} b3chunk_t;
+
+typedef struct blake3_t {
+  b3chunk_t chunk;
+  uint32_t stack[BLAKE3_MAX_DEPTH][8]; // chaining values of subtrees.
+  int depth;
+} blake3_t;
+
+void
+blake3_init(blake3_t *b);
+
+void
+blake3_update(blake3_t *b, const void *p, size_t n);
+
+void
+blake3_final(const blake3_t *b, unsigned char *out, size_t len);
+
+#endif
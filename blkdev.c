@@ -0,0 +1,59 @@
+/*    blkdev.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of blkdev.[h|c] is to find the kind of a block device.
+ * See blkdev.h.
+ * */
+
+#include <sys/sysmacros.h>
+#include <limits.h>
+#include "blkdev.h"
+
+static int
+read_flag(const char *path);
+
+int
+blkdev_rotational(dev_t dev)
+{ /* Returns 1 if dev, a st_dev, is a spinning disk, 0 if not, or -1
+   * if there is no block device to ask about, as for tmpfs, NFS or
+   * overlay filesystems. A partition has no queue of its own, its
+   * disk's is one level up.
+  */
+  char path[PATH_MAX];
+  unsigned maj = major(dev), min = minor(dev);
+  snprintf(path, PATH_MAX, "/sys/dev/block/%u:%u/queue/rotational",
+           maj, min);
+  int res = read_flag(path);
+  if (res != -1) return res;
+  snprintf(path, PATH_MAX, "/sys/dev/block/%u:%u/../queue/rotational",
+           maj, min);
+  return read_flag(path);
+} // blkdev_rotational()
+
+static int
+read_flag(const char *path)
+{ /* the 0 or 1 in a sysfs file, or -1 if it can not be read. */
+  FILE *fp = fopen(path, "r");
+  if (!fp) return -1;
+  int c = fgetc(fp);
+  fclose(fp);
+  if (c == '0' || c == '1') return c - '0';
+  return -1;
+} // read_flag()
@@ -0,0 +1,39 @@
+/*    blkdev.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of blkdev.[h|c] is to say what kind of block device
+ * holds a filesystem, from what the kernel reports under /sys, so that
+ * the number of concurrent reads can suit it: one stream for a
+ * spinning disk, which only seeks the more for more, and a deep queue
+ * for solid state.
+ * */
+
+#ifndef _BLKDEV_H
+#define _BLKDEV_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+blkdev_rotational(dev_t dev);
+
+#endif
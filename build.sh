@@ -25,8 +25,32 @@ gcc -Wall -Wextra -O0 -g -c files.c
 gcc -Wall -Wextra -O0 -g -c str.c
 gcc -Wall -Wextra -O0 -g -c firstrun.c
 gcc -Wall -Wextra -O0 -g -c gopt.c
-gcc filedups.o calcmd5.o dirs.o files.o str.o firstrun.o gopt.o \
--lmhash -o filedups
+gcc -Wall -Wextra -O0 -g -c walk.c
+gcc -Wall -Wextra -O0 -g -c uring.c
+gcc -Wall -Wextra -O0 -g -c arena.c
+gcc -Wall -Wextra -O0 -g -c pathstore.c
+gcc -Wall -Wextra -O0 -g -c rsort.c
+gcc -Wall -Wextra -O0 -g -c sizeidx.c
+gcc -Wall -Wextra -O0 -g -c extsort.c
+gcc -Wall -Wextra -O0 -g -c hash.c
+gcc -Wall -Wextra -O0 -g -c blake3.c
+gcc -Wall -Wextra -O0 -g -c xxh3_base.c
+gcc -Wall -Wextra -O0 -g -c xxh3_avx2.c
+gcc -Wall -Wextra -O0 -g -c xxh3_avx512.c
+gcc -Wall -Wextra -O0 -g -c extent.c
+gcc -Wall -Wextra -O0 -g -c blkdev.c
+gcc -Wall -Wextra -O0 -g -c ringhash.c
+gcc -Wall -Wextra -O0 -g -c throttle.c
+gcc -Wall -Wextra -O0 -g -c lockstep.c
+gcc -Wall -Wextra -O0 -g -c md5mb_base.c
+gcc -Wall -Wextra -O0 -g -c md5mb_avx2.c
+gcc -Wall -Wextra -O0 -g -c md5mb_avx512.c
+gcc filedups.o calcmd5.o dirs.o files.o str.o firstrun.o gopt.o walk.o \
+uring.o arena.o pathstore.o rsort.o sizeidx.o extsort.o hash.o blake3.o \
+xxh3_base.o xxh3_avx2.o xxh3_avx512.o extent.o blkdev.o \
+ringhash.o throttle.o lockstep.o md5mb_base.o md5mb_avx2.o \
+md5mb_avx512.o \
+-lmhash -lpthread -o filedups
 
 #gcc -Wall -Wextra -O0 -g -o procdups procdups.c
 
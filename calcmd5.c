@@ -1,47 +1,735 @@
-#include <mhash.h>
+#include "str.h"
 #include "calcmd5.h"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <linux/if_alg.h>
 
-char
-*calcmd5(const char *path, int pages)
-{
-  size_t bytes_read;
-  MHASH td;
-  unsigned char buffer[4096];
-  unsigned char hash[16]; /* fits MD5 */
-  static char result[33];
-  FILE *fpi = fopen(path, "r");
-  if (!fpi) {
-    perror(path); // It's ok if a file or so goes AWL during processing.
-    strcpy(result, "");
-    return result;
+static size_t blocksize = CALC_BLOCK;
+static int cacheflags;  // see calcmd5_cachemode().
+static tb_t *throttle;  // a token for each byte read, NULL for no limit.
+static int algfd = -1;  // AF_ALG md5, see calcmd5_kernel().
+static pthread_once_t bus_once = PTHREAD_ONCE_INIT;
+static __thread sigjmp_buf *bus_jmp;  // set while a mapping is hashed.
+
+struct c5batch_t {  // small files read, to be hashed together.
+  int n;
+  unsigned char *buf[CALC_BATCH];
+  size_t len[CALC_BATCH];
+  md5_t *md5[CALC_BATCH];
+};
+
+static int
+hashfile(const char *path, const void *prefix, size_t plen, off_t from,
+         int pages, md5_t *md5);
+static int
+hash_read(int fd, hash_t *td, off_t from, int pages, off_t left);
+static int
+hash_mapped(int fd, hash_t *td, off_t from, off_t left);
+static void
+bus_install(void);
+static void
+bus_handler(int sig);
+static int
+hash_kernel(int fd, const void *prefix, size_t plen, off_t from,
+            int pages, unsigned char *hash);
+static int
+open_file(const char *path);
+static int
+load_small(c5batch_t *b, int fd, const struct stat *sb, const void *prefix,
+           size_t plen, off_t from, int pages);
+static void
+next_data(int fd, off_t pos, off_t end, off_t *ds, off_t *de,
+          int *seekable);
+static void
+resident(int fd, off_t pos, size_t len, unsigned char *vec);
+static void
+drop_new(int fd, off_t pos, size_t len, const unsigned char *vec);
+
+int
+calcmd5(const char *path, int pages, md5_t *md5)
+{ /* Put the md5sum of the file at path into md5. Returns 0, or -1 if
+   * the file can not be read.
+  */
+  return hashfile(path, NULL, 0, 0, pages, md5);
+} // calcmd5()
+
+int
+calcmd5_block(const char *path, const void *prefix, size_t plen,
+              off_t from, int pages, md5_t *md5)
+{ /* Put the md5sum of plen bytes of prefix, followed by pages of the
+   * file at path starting at offset from, into md5. Returns 0, or -1
+   * if the file can not be read.
+  */
+  return hashfile(path, prefix, plen, from, pages, md5);
+} // calcmd5_block()
+
+int
+calcmd5_sample(const char *path, const void *prefix, size_t plen,
+               int samples, int pages, md5_t *md5)
+{ /* Put the digest of plen bytes of prefix, followed by samples blocks
+   * of pages each spread evenly over the file at path, into md5. The
+   * first block is the head of the file and the last its tail, and
+   * those between start on a page. A file no bigger than a block is
+   * hashed whole. Returns 0, or -1 if the file can not be read.
+  */
+  struct stat sb;
+  int fd = open_file(path);
+  if (fd == -1 || fstat(fd, &sb) == -1) {
+    perror(path);
+    if (fd != -1) close(fd);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  int fl = fcntl(fd, F_GETFL);
+  if (fl != -1 && (fl & O_DIRECT)) { // the tail block is not aligned.
+    fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+  }
+  off_t size = sb.st_size;
+  size_t blk = (size_t)((pages > 0) ? pages : 1) * 4096;
+  if ((off_t)blk >= size) {
+    blk = size;
+    samples = 1;
   }
+  if (samples < 1) samples = 1;
+  unsigned char *buffer = xcalloc(blk + 1, 1);
+  unsigned char *vec = (cacheflags & CALC_NEUTRAL)
+                       ? xcalloc(blk / 4096 + 2, 1) : NULL;
+  if (vec) posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  hash_t td;
+  hash_start(&td);
+  if (plen) hash_update(&td, prefix, plen);
+  int i, res = 0;
+  for (i = 0; i < samples && res == 0; i++) {
+    off_t pos = (samples == 1) ? 0
+                : (off_t)((size - blk) * (double)i / (samples - 1));
+    if (i > 0 && i < samples - 1) pos &= ~(off_t)4095;
+    if (vec) resident(fd, pos, blk, vec);
+    tb_take(throttle, blk);
+    size_t got = 0;
+    while (got < blk) {
+      ssize_t n = pread(fd, buffer + got, blk - got, pos + got);
+      if (n == -1 && errno == EINTR) continue;
+      if (n == -1) res = -1;
+      if (n <= 0) break;  // a shorter file is hashed as it is.
+      got += n;
+    }
+    hash_update(&td, buffer, got);
+    if (vec) drop_new(fd, pos, got, vec);
+  } // for(i...)
+  unsigned char hash[HASH_LEN];
+  hash_final(&td, hash);
+  int err = errno;
+  close(fd);
+  free(vec);
+  free(buffer);
+  if (res == -1) {
+    errno = err;
+    perror(path);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  md5set(md5, hash);
+  return 0;
+} // calcmd5_sample()
+
+int
+calcmd5_sparse(const char *path, off_t from, off_t len, md5_t *md5)
+{ /* Put the sparse digest of len bytes of the file at path from offset
+   * from into md5: the digest of len, as 8 bytes most significant
+   * first, followed by a digest for each CALC_SPARSE chunk in turn; the
+   * digest of a chunk of zeros is 16 zero bytes. The holes are found
+   * with SEEK_DATA and SEEK_HOLE and are not read, so a sparse file is
+   * hashed at the speed of its data. The digest depends only on what
+   * the file holds, not on where its holes are, so a sparse file and a
+   * copy written out in full match. Returns 0, or -1 if the file can
+   * not be read.
+  */
+  struct stat sb;
+  int fd = open_file(path);
+  if (fd == -1 || fstat(fd, &sb) == -1) {
+    perror(path);
+    if (fd != -1) close(fd);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  int fl = fcntl(fd, F_GETFL);
+  if (fl != -1 && (fl & O_DIRECT)) { // data starts on a block, not a page.
+    fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+  }
+  off_t end = (from + len < sb.st_size) ? from + len : sb.st_size;
+  if (end < from) end = from;
+  unsigned char *buffer = xcalloc(CALC_SPARSE, 1);
+  unsigned char *vec = (cacheflags & CALC_NEUTRAL)
+                       ? xcalloc(CALC_SPARSE / 4096 + 2, 1) : NULL;
+  if (vec) posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  hash_t top;
+  unsigned char bytes[HASH_LEN];
+  int i;
+  hash_start(&top);
+  for (i = 0; i < 8; i++) bytes[i] = (uint64_t)(end - from) >> (8 * (7 - i));
+  hash_update(&top, bytes, 8);
+  off_t ds, de;  // the run of data at, or after, the chunk.
+  int seekable = 1, res = 0;
+  next_data(fd, from, end, &ds, &de, &seekable);
+  off_t c;
+  for (c = from; c < end && res == 0; c += CALC_SPARSE) {
+    off_t ce = (c + CALC_SPARSE < end) ? c + CALC_SPARSE : end;
+    int data = 0;
+    memset(buffer, 0, ce - c);
+    while (ds < ce && res == 0) { // each run of data in the chunk.
+      off_t rs = (ds > c) ? ds : c;
+      off_t re = (de < ce) ? de : ce;
+      if (vec) resident(fd, rs, re - rs, vec);
+      tb_take(throttle, re - rs);
+      off_t got = 0;
+      while (rs + got < re) {
+        ssize_t n = pread(fd, buffer + (rs - c) + got, re - rs - got,
+                          rs + got);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) res = -1;
+        if (n <= 0) break;  // a file got shorter reads as zeros.
+        got += n;
+      }
+      if (vec) drop_new(fd, rs, got, vec);
+      data = 1;
+      if (de > ce) break; // the run goes on into the next chunk.
+      next_data(fd, de, end, &ds, &de, &seekable);
+    } // while()
+    if (data) { // data may still be all zeros.
+      size_t k;
+      for (k = 0; k < (size_t)(ce - c) && !buffer[k]; k++) ;
+      data = (k < (size_t)(ce - c));
+    }
+    if (data) {
+      hash_t td;
+      hash_start(&td);
+      hash_update(&td, buffer, ce - c);
+      hash_final(&td, bytes);
+    } else {
+      memset(bytes, 0, HASH_LEN);
+    }
+    hash_update(&top, bytes, HASH_LEN);
+  } // for(c...)
+  hash_final(&top, bytes);
+  int err = errno;
+  close(fd);
+  free(vec);
+  free(buffer);
+  if (res == -1) {
+    errno = err;
+    perror(path);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  md5set(md5, bytes);
+  return 0;
+} // calcmd5_sparse()
 
-  td = mhash_init(MHASH_MD5);
-  if (td == MHASH_FAILED) {
-    perror("Hash init failed");
-    exit(1);
+static void
+next_data(int fd, off_t pos, off_t end, off_t *ds, off_t *de,
+          int *seekable)
+{ /* Set [*ds, *de) to the first run of data at or after pos, or both to
+   * end if there is none before it. Where the filesystem can not tell
+   * holes from data, *seekable is cleared and all is taken as data.
+  */
+  *ds = (*seekable) ? lseek(fd, pos, SEEK_DATA) : pos;
+  if (*ds == -1 && errno == EINVAL) {
+    *seekable = 0;
+    *ds = pos;
+  }
+  if (*ds == -1 || *ds >= end) { // ENXIO, nothing but a hole is left.
+    *ds = *de = end;
+    return;
   }
-  /* I don't necessarily calculate the hash of the entire file, but
+  *de = (*seekable) ? lseek(fd, *ds, SEEK_HOLE) : end;
+  if (*de == -1 || *de > end) *de = end;
+} // next_data()
+
+c5batch_t
+*calcmd5_batch_init(void)
+{ /* an empty batch, see calcmd5_batch_add(). */
+  c5batch_t *b = xcalloc(1, sizeof(struct c5batch_t));
+  int i;
+  for (i = 0; i < CALC_BATCH; i++) b->buf[i] = xcalloc(CALC_SMALL, 1);
+  return b;
+} // calcmd5_batch_init()
+
+int
+calcmd5_batch_add(c5batch_t *b, const char *path, const void *prefix,
+                  size_t plen, off_t from, int pages, md5_t *md5)
+{ /* As calcmd5_block(), but where what is to be hashed comes to no more
+   * than CALC_SMALL bytes it is read now and hashed, together with the
+   * rest of the batch, by calcmd5_batch_run(); md5 is not filled in
+   * until then. hash_many() can then hash the files side by side. A
+   * bigger file, or any file if the algorithm has no gain from it, the
+   * page cache is to be spared or the kernel hashes, is hashed at once.
+   * Returns 0, or -1 if the file can not be read.
+  */
+  if (hash_lanes() < 2 || cacheflags || algfd != -1) {
+    return hashfile(path, prefix, plen, from, pages, md5);
+  }
+  struct stat sb;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1 || fstat(fd, &sb) == -1) {
+    perror(path);
+    if (fd != -1) close(fd);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  if (b->n == CALC_BATCH) calcmd5_batch_run(b);
+  int res = load_small(b, fd, &sb, prefix, plen, from, pages);
+  int err = errno;
+  close(fd);
+  if (res == 1) return hashfile(path, prefix, plen, from, pages, md5);
+  if (res == -1) {
+    errno = err;
+    perror(path);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  b->md5[b->n++] = md5;
+  return 0;
+} // calcmd5_batch_add()
+
+static int
+load_small(c5batch_t *b, int fd, const struct stat *sb, const void *prefix,
+           size_t plen, off_t from, int pages)
+{ /* Read the prefix and the bytes to hash into the next buffer of the
+   * batch. Returns 0, 1 if they would not fit, or -1 with errno set.
+  */
+  off_t left = (sb->st_size > from) ? sb->st_size - from : 0;
+  if (pages > 0 && (off_t)pages * 4096 < left) left = (off_t)pages * 4096;
+  if ((off_t)plen + left > CALC_SMALL) return 1;
+  unsigned char *buf = b->buf[b->n];
+  if (plen) memcpy(buf, prefix, plen);
+  size_t got = plen;
+  tb_take(throttle, left);
+  while (left) {
+    ssize_t r = pread(fd, buf + got, left, from);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) return -1;
+    if (r == 0) break;  // the file got shorter.
+    got += r;
+    from += r;
+    left -= r;
+  }
+  b->len[b->n] = got;
+  return 0;
+} // load_small()
+
+void
+calcmd5_batch_run(c5batch_t *b)
+{ /* Hash the files of the batch and fill in their digests. */
+  unsigned char hash[CALC_BATCH][HASH_LEN];
+  int i;
+  if (!b->n) return;
+  hash_many((const unsigned char **)b->buf, b->len, b->n, hash);
+  for (i = 0; i < b->n; i++) md5set(b->md5[i], hash[i]);
+  b->n = 0;
+} // calcmd5_batch_run()
+
+void
+calcmd5_batch_free(c5batch_t *b)
+{ /* Release a batch, which should have been run. */
+  int i;
+  if (!b) return;
+  for (i = 0; i < CALC_BATCH; i++) free(b->buf[i]);
+  free(b);
+} // calcmd5_batch_free()
+
+static int
+hashfile(const char *path, const void *prefix, size_t plen, off_t from,
+         int pages, md5_t *md5)
+{ /* The work of calcmd5() and calcmd5_block(), using the algorithm of
+   * hash_select(), see hash.h. MD5 is only the default.
+   * I don't necessarily calculate the hash of the entire file, but
    * rather the number of 4096 byte pages specified. However, if the
-   * pages specified is less than 1, the whole file is hashed. */
+   * pages specified is less than 1, the whole file is hashed. Past
+   * CALC_MMAP bytes the file is mapped rather than read, unless the page
+   * cache is to be spared. With calcmd5_kernel() the kernel does it all.
+  */
+  hash_t td;
+  unsigned char hash[HASH_LEN];
+  struct stat sb;
+  int fd = open_file(path);
+  if (fd == -1 || fstat(fd, &sb) == -1) {
+    perror(path); // It's ok if a file or so goes AWL during processing.
+    if (fd != -1) close(fd);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  off_t left = (sb.st_size > from) ? sb.st_size - from : 0;
+  if (pages > 0 && (off_t)pages * 4096 < left) left = (off_t)pages * 4096;
+
+  int res = -2;  // not hashed by the kernel.
+  if (algfd != -1 && !cacheflags) {
+    res = hash_kernel(fd, prefix, plen, from, pages, hash);
+  }
+  if (res == -2) {
+    hash_start(&td);
+    if (plen) hash_update(&td, prefix, plen);
+    res = (left >= CALC_MMAP && !cacheflags)
+          ? hash_mapped(fd, &td, from, left) : 1;
+    if (res == 1) res = hash_read(fd, &td, from, pages, left);
+    hash_final(&td, hash);
+  }
+  int err = errno;
+  close(fd);
+  if (res == -1) {
+    errno = err;
+    perror(path);
+    memset(md5, 0, sizeof(md5_t));
+    return -1;
+  }
+  md5set(md5, hash);
+  return 0;
+} // hashfile()
+
+static int
+hash_read(int fd, hash_t *td, off_t from, int pages, off_t left)
+{ /* Hash the pages from offset from, or all to the end of the file if
+   * pages < 1, with reads of up to blocksize into an aligned buffer; no
+   * bigger than left, the part of the file expected, needs. Returns 0,
+   * or -1 with errno set.
+   * With O_DIRECT the reads start on a page boundary and are of whole
+   * pages, the bytes before from being passed over. With CALC_NEUTRAL
+   * the pages each read brings into the page cache are dropped again
+   * once hashed, but not those that were there already.
+  */
+  int fl = fcntl(fd, F_GETFL);
+  int direct = (fl != -1 && (fl & O_DIRECT));
+  size_t bufsz = blocksize;
+  if ((off_t)bufsz > left + 4096) bufsz = (left + 4096 + 4095) / 4096 * 4096;
+  unsigned char *buffer;
+  if (posix_memalign((void **)&buffer, 4096, bufsz)) {
+    perror("posix_memalign");
+    exit(EXIT_FAILURE);
+  }
+  unsigned char *vec = (cacheflags & CALC_NEUTRAL)
+                       ? xcalloc(bufsz / 4096 + 2, 1) : NULL;
+  if (vec) { // read ahead would make the next block look cached.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  } else if (pages < 1) { // the read ahead window is doubled.
+    posix_fadvise(fd, from, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  off_t want = (pages > 0) ? (off_t)pages * 4096 : -1;
+  off_t pos = (direct) ? from & ~(off_t)4095 : from;
+  size_t skip = from - pos;
+  while (want) {
+    size_t len = bufsz;
+    if (want > 0 && want + (off_t)skip < (off_t)len) len = want + skip;
+    if (direct) len = (len + 4095) / 4096 * 4096;
+    if (len > bufsz) len = bufsz;
+    if (vec) resident(fd, pos, len, vec);
+    tb_take(throttle, len);
+    ssize_t n = pread(fd, buffer, len, pos);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1 && errno == EINVAL && direct) { // opened but not read so.
+      fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+      direct = 0;
+      continue;
+    }
+    if (n == -1) {
+      free(vec);
+      free(buffer);
+      return -1;
+    }
+    if ((size_t)n <= skip) break;  // file size too small anyway.
+    size_t use = n - skip;
+    if (want > 0 && (off_t)use > want) use = want;
+    hash_update(td, buffer + skip, use);
+    if (vec) drop_new(fd, pos, n, vec);
+    pos += n;
+    skip = 0;
+    if (want > 0) want -= use;
+  } // while()
+  free(vec);
+  free(buffer);
+  return 0;
+} // hash_read()
+
+static void
+resident(int fd, off_t pos, size_t len, unsigned char *vec)
+{ /* Put into vec a byte for each page from the one holding pos to the
+   * one holding pos + len - 1, with bit 0 set if it is in the page
+   * cache. The range is mapped without being touched, so nothing is
+   * read. If mincore(2) can't be had every page is taken as not.
+  */
+  off_t base = pos & ~(off_t)4095;
+  size_t maplen = len + (pos - base);
+  memset(vec, 0, (maplen + 4095) / 4096);
+  void *p = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, base);
+  if (p == MAP_FAILED) return;
+  if (mincore(p, maplen, vec) == -1) memset(vec, 0, (maplen + 4095) / 4096);
+  munmap(p, maplen);
+} // resident()
+
+static void
+drop_new(int fd, off_t pos, size_t len, const unsigned char *vec)
+{ /* POSIX_FADV_DONTNEED each run of pages that resident() found not
+   * to be cached, now that they have been read. */
+  off_t base = pos & ~(off_t)4095;
+  size_t pages = (len + (pos - base) + 4095) / 4096;
+  size_t i, j;
+  for (i = 0; i < pages; i = j) {
+    for (j = i; j < pages && (vec[j] & 1) == (vec[i] & 1); j++) ;
+    if (!(vec[i] & 1)) {
+      posix_fadvise(fd, base + i * 4096, (j - i) * 4096,
+                    POSIX_FADV_DONTNEED);
+    }
+  }
+} // drop_new()
+
+static int
+hash_mapped(int fd, hash_t *td, off_t from, off_t left)
+{ /* Hash left bytes from offset from by mapping them, which saves
+   * copying a large file through a buffer; the kernel is told it will
+   * be read straight through. Returns 0, 1 with nothing hashed if the
+   * file can not be mapped, or -1 with errno set to EIO if it was cut
+   * short while mapped: the SIGBUS that brings is caught by
+   * bus_handler() and only this file is lost.
+  */
+  off_t base = from & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+  size_t skip = from - base;
+  size_t maplen = skip + left;
+  unsigned char *p = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, base);
+  if (p == MAP_FAILED) return 1;
+  pthread_once(&bus_once, bus_install);
+  madvise(p, maplen, MADV_SEQUENTIAL);
+  sigjmp_buf jb;
+  if (sigsetjmp(jb, 1)) {
+    bus_jmp = NULL;
+    munmap(p, maplen);
+    errno = EIO;
+    return -1;
+  }
+  bus_jmp = &jb;
+  off_t off;
+  for (off = 0; off < left; off += blocksize) {
+    size_t len = (left - off < (off_t)blocksize) ? (size_t)(left - off)
+                                                 : blocksize;
+    tb_take(throttle, len); // the page faults do the reading.
+    hash_update(td, p + skip + off, len);
+  }
+  bus_jmp = NULL;
+  munmap(p, maplen);
+  return 0;
+} // hash_mapped()
+
+static void
+bus_install(void)
+{ /* Catch SIGBUS for hash_mapped(), once for all threads. */
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = bus_handler;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGBUS, &sa, NULL) == -1) {
+    perror("sigaction");
+    exit(EXIT_FAILURE);
+  }
+} // bus_install()
+
+static void
+bus_handler(int sig)
+{ /* A SIGBUS in a thread hashing a mapping goes back to hash_mapped();
+   * any other is left to kill the program as it would have.
+  */
+  if (bus_jmp) siglongjmp(*bus_jmp, 1);
+  signal(sig, SIG_DFL);
+  raise(sig);
+} // bus_handler()
+
+static int
+hash_kernel(int fd, const void *prefix, size_t plen, off_t from,
+            int pages, unsigned char *hash)
+{ /* Hash as hashfile() does, but in the kernel: the file's pages are
+   * spliced from the page cache through a pipe into an AF_ALG md5
+   * socket, never being copied out to user space, and only the digest
+   * is read back. Returns 0, -1 with errno set, or -2 if the file can
+   * not be spliced, as on some FUSE mounts, found before any of it is
+   * hashed.
+  */
+  int op = accept(algfd, NULL, 0);
+  if (op == -1) return -2;
+  int pfd[2];
+  if (pipe2(pfd, O_CLOEXEC) == -1) {
+    close(op);
+    return -2;
+  }
+  int chunk = fcntl(pfd[1], F_SETPIPE_SZ, blocksize);
+  if (chunk == -1) chunk = fcntl(pfd[1], F_GETPIPE_SZ);
+  if (chunk == -1) chunk = 65536;
+  int res = 0;
+  if (plen && send(op, prefix, plen, MSG_MORE) != (ssize_t)plen) res = -1;
+  off_t want = (pages > 0) ? (off_t)pages * 4096 : -1;
+  loff_t pos = from;
+  int first = 1;
+  while (!res && want) {
+    size_t len = chunk;
+    if (want > 0 && want < (off_t)len) len = want;
+    tb_take(throttle, len);
+    ssize_t n = splice(fd, &pos, pfd[1], NULL, len,
+                       SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1) {
+      res = (first && errno == EINVAL) ? -2 : -1;
+      break;
+    }
+    if (n == 0) break;  // file size too small anyway.
+    first = 0;
+    ssize_t out = n;
+    while (out) { // all that is in the pipe goes to the socket.
+      ssize_t m = splice(pfd[0], NULL, op, NULL, out,
+                         SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (m == -1 && errno == EINTR) continue;
+      if (m <= 0) {
+        if (m == 0) errno = EIO;
+        res = -1;
+        break;
+      }
+      out -= m;
+    }
+    if (want > 0) want -= n;
+  } // while()
+  // a send without MSG_MORE ends the hash.
+  if (!res && (send(op, NULL, 0, 0) == -1 ||
+               read(op, hash, HASH_LEN) != HASH_LEN)) res = -1;
+  int err = errno;
+  close(pfd[0]);
+  close(pfd[1]);
+  close(op);
+  errno = err;
+  return res;
+} // hash_kernel()
+
+static int
+open_file(const char *path)
+{ /* Open path for hashing, as calcmd5_cachemode() asks. O_NOATIME
+   * needs the file to be ours, and O_DIRECT a filesystem that has it;
+   * each is let go if it is refused.
+  */
+  int flags = O_RDONLY;
+  if (cacheflags & CALC_NEUTRAL) flags |= O_NOATIME;
+  if (cacheflags & CALC_DIRECT) flags |= O_DIRECT;
+  int fd = open(path, flags);
+  if (fd == -1 && errno == EPERM && (flags & O_NOATIME)) {
+    flags &= ~O_NOATIME;
+    fd = open(path, flags);
+  }
+  if (fd == -1 && errno == EINVAL && (flags & O_DIRECT)) {
+    flags &= ~O_DIRECT;
+    fd = open(path, flags);
+  }
+  return fd;
+} // open_file()
+
+void
+calcmd5_blocksize(size_t bytes)
+{ /* Set the size of the reads made, in whole pages. To be called before
+   * any hashing starts. */
+  bytes = (bytes + 4095) / 4096 * 4096;
+  blocksize = (bytes) ? bytes : 4096;
+} // calcmd5_blocksize()
+
+void
+calcmd5_cachemode(int flags)
+{ /* Set how reading files for hashing treats the page cache, flags
+   * being 0 or CALC_NEUTRAL, with or without CALC_DIRECT. To be called
+   * before any hashing starts. */
+  cacheflags = flags;
+} // calcmd5_cachemode()
+
+int
+calcmd5_kernel(void)
+{ /* Have MD5 done by the kernel's crypto API, which may use hardware
+   * the cpu has for it, see hash_kernel(). The digests are the same.
+   * Returns 0, or -1 with errno set if the kernel has no AF_ALG md5, or
+   * another algorithm is chosen, when hashing stays in user space. To
+   * be called after hash_select() and before any hashing starts.
+  */
+  if (hash_selected() != ALGO_MD5) {
+    errno = EINVAL;
+    return -1;
+  }
+  struct sockaddr_alg sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.salg_family = AF_ALG;
+  strcpy((char *)sa.salg_type, "hash");
+  strcpy((char *)sa.salg_name, "md5");
+  int s = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (s == -1) return -1;
+  if (bind(s, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+    int err = errno;
+    close(s);
+    errno = err;
+    return -1;
+  }
+  algfd = s;
+  return 0;
+} // calcmd5_kernel()
+
+void
+calcmd5_throttle(tb_t *tb)
+{ /* Hold reading to the rate of tb, in bytes a second. To be called
+   * before any hashing starts. */
+  throttle = tb;
+} // calcmd5_throttle()
+
+int
+calcmd5_prefetch(const char *path, off_t from, int pages)
+{ /* Have the kernel start reading the first block that calcmd5_block()
+   * would read of path, without waiting for it; meant for the next file
+   * while this one is hashed. Returns 0, or -1 if the file can not be
+   * opened, which the hashing will report in its turn. Nothing is done
+   * when the page cache is to be spared.
+  */
+  if (cacheflags) return 0;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return -1;
+  off_t len = blocksize;
+  if (pages > 0 && (off_t)pages * 4096 < len) len = (off_t)pages * 4096;
+  posix_fadvise(fd, from, len, POSIX_FADV_WILLNEED);
+  close(fd);
+  return 0;
+} // calcmd5_prefetch()
+
+void
+md5set(md5_t *md5, const unsigned char *bytes)
+{ /* the sum from the 16 bytes of a digest, the inverse of md5bytes(). */
   int i;
-  if (pages > 0) {
-    for (i = 0; i < pages; i++) {
-      bytes_read = fread(buffer, 1, 4096, fpi);
-      mhash(td, buffer, bytes_read);
-      if (bytes_read < 4096) break; // file size too small anyway.
-    }
-  } else {
-    while ((bytes_read = fread(buffer, 1, 4096, fpi)) > 0) {
-      mhash(td, buffer, bytes_read);
-    } // while
-  } // else
-
-  mhash_deinit(td, hash);
-  int j;
-  for (i = 0, j = 0; i < 16; i++, j += 2) {
-    sprintf(&result[j], "%.2x", hash[i]);
-  }
-  fclose(fpi);
-  return result;
-} // calcmd5()
+  md5->w[0] = md5->w[1] = 0;
+  for (i = 0; i < 16; i++) {
+    md5->w[i / 8] = (md5->w[i / 8] << 8) | bytes[i];
+  }
+} // md5set()
+
+void
+md5bytes(const md5_t *md5, unsigned char *bytes)
+{ /* the 16 bytes of the sum, in the order md5hex() shows them. */
+  int i;
+  for (i = 0; i < 16; i++) bytes[i] = md5->w[i / 8] >> (8 * (7 - i % 8));
+} // md5bytes()
+
+int
+md5cmp(const md5_t *a, const md5_t *b)
+{ /* like strcmp() on the hex strings of a and b. */
+  if (a->w[0] != b->w[0]) return (a->w[0] > b->w[0]) ? 1 : -1;
+  if (a->w[1] != b->w[1]) return (a->w[1] > b->w[1]) ? 1 : -1;
+  return 0;
+} // md5cmp()
+
+char
+*md5hex(const md5_t *md5, char *hex)
+{ /* hex must have room for 33 chars. */
+  int i;
+  for (i = 0; i < 16; i++) {
+    unsigned byte = (md5->w[i / 8] >> (8 * (7 - i % 8))) & 0xff;
+    sprintf(&hex[2 * i], "%.2x", byte);
+  }
+  return hex;
+} // md5hex()
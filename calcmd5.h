@@ -2,14 +2,87 @@
 #define	_CALCMD5_H 1
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <mhash.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include <mhash.h>
+#include "hash.h"
+#include "throttle.h"
+
+#define CALC_BLOCK (1024 * 1024)  // default size of the reads made.
+#define CALC_MMAP (64 << 20)      // a file is mapped from this size.
+// calcmd5_cachemode() flags.
+#define CALC_NEUTRAL 1  // O_NOATIME, and leave the page cache as it was.
+#define CALC_DIRECT 2   // O_DIRECT, by-passing the page cache.
+// see calcmd5_batch_add().
+#define CALC_SMALL (64 * 1024)  // most bytes a file may put in a batch.
+#define CALC_BATCH 16           // files a batch holds.
+#define CALC_SPARSE (1 << 20)   // bytes of a sparse digest's chunks.
+
+/* An md5sum held as two words, each loaded most significant byte
+ * first, so that comparing the words compares the sums as the hex
+ * strings would compare. The other algorithms of hash.h give 16 byte
+ * digests too and are held the same way. */
+typedef struct md5_t {
+  uint64_t w[2];
+} md5_t;
+
+int
+calcmd5(const char *path, int pages, md5_t *md5);
+
+int
+calcmd5_block(const char *path, const void *prefix, size_t plen,
+              off_t from, int pages, md5_t *md5);
+
+int
+calcmd5_sample(const char *path, const void *prefix, size_t plen,
+               int samples, int pages, md5_t *md5);
+
+int
+calcmd5_sparse(const char *path, off_t from, off_t len, md5_t *md5);
+
+typedef struct c5batch_t c5batch_t;
+
+c5batch_t
+*calcmd5_batch_init(void);
+
+int
+calcmd5_batch_add(c5batch_t *b, const char *path, const void *prefix,
+                  size_t plen, off_t from, int pages, md5_t *md5);
+
+void
+calcmd5_batch_run(c5batch_t *b);
+
+void
+calcmd5_batch_free(c5batch_t *b);
+
+void
+calcmd5_blocksize(size_t bytes);
+
+void
+calcmd5_cachemode(int flags);
+
+void
+calcmd5_throttle(tb_t *tb);
+
+int
+calcmd5_kernel(void);
+
+int
+calcmd5_prefetch(const char *path, off_t from, int pages);
+
+void
+md5set(md5_t *md5, const unsigned char *bytes);
+
+void
+md5bytes(const md5_t *md5, unsigned char *bytes);
+
+int
+md5cmp(const md5_t *a, const md5_t *b);
 
-char 
-*calcmd5(const char *path, int pages);
+char
+*md5hex(const md5_t *md5, char *hex);
 
 #endif /* calcmd5.h  */
@@ -0,0 +1,60 @@
+/*    extent.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of extent.[h|c] is to find where the data of a file
+ * begins on its device. See extent.h.
+ * */
+
+#include "extent.h"
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+// flags for an extent whose fe_physical is not a usable disk address.
+#define EXTENT_NOADDR (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC \
+                       | FIEMAP_EXTENT_DATA_INLINE \
+                       | FIEMAP_EXTENT_NOT_ALIGNED)
+
+int
+extent_first(const char *path, uint64_t *physical)
+{ /* Put the byte address on its device of the first extent of the file
+   * at path into *physical and return 0, or return -1 if there is no
+   * such address to be had.
+  */
+  struct {
+    struct fiemap fm;
+    struct fiemap_extent fe;
+  } m;
+  int fd = open(path, O_RDONLY | O_NOATIME);
+  if (fd == -1) fd = open(path, O_RDONLY); // O_NOATIME needs ownership.
+  if (fd == -1) return -1;
+  memset(&m, 0, sizeof(m));
+  m.fm.fm_start = 0;
+  m.fm.fm_length = FIEMAP_MAX_OFFSET;
+  m.fm.fm_extent_count = 1;
+  int res = ioctl(fd, FS_IOC_FIEMAP, &m.fm);
+  close(fd);
+  if (res == -1 || m.fm.fm_mapped_extents == 0) return -1;
+  if (m.fe.fe_flags & EXTENT_NOADDR) return -1;
+  *physical = m.fe.fe_physical;
+  return 0;
+} // extent_first()
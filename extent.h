@@ -0,0 +1,42 @@
+/*    extent.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of extent.[h|c] is to find where on the device the data
+ * of a file begins, using the FIEMAP ioctl(2). On a spinning disk,
+ * reading files in the order of their first extents saves most of the
+ * seeking that inode order still leaves. Where the filesystem has no
+ * FIEMAP, or the file has no extent with a known address, as empty,
+ * inline or not yet allocated files, extent_first() fails and callers
+ * are expected to fall back to inode order.
+ * */
+
+#ifndef _EXTENT_H
+#define _EXTENT_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+extent_first(const char *path, uint64_t *physical);
+
+#endif
@@ -0,0 +1,250 @@
+/*    extsort.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of extsort.[h|c] is to sort records that may not fit in
+ * memory. See extsort.h.
+ * */
+
+#include <unistd.h>
+#include "extsort.h"
+
+static void
+spill(extsort_t *xs);
+static void
+open_runs(extsort_t *xs);
+static int
+pop(extsort_t *xs, void *rec);
+static void
+close_runs(extsort_t *xs);
+static void
+sift_down(extsort_t *xs, int i);
+static void
+run_name(const extsort_t *xs, int n, char *buf);
+
+extsort_t
+*xs_init(const char *dir, const char *tag, const rsort_t *how,
+         size_t budget, int nthreads)
+{ /* Records of how->size bytes, buffered up to budget bytes, runs
+   * named for tag in dir. */
+  extsort_t *xs = xcalloc(1, sizeof(struct extsort_t));
+  xs->how = how;
+  xs->nthreads = nthreads;
+  xs->cap = budget / how->size;
+  if (xs->cap < 1024) xs->cap = 1024;
+  xs->buf = xmalloc(xs->cap * how->size);
+  if (snprintf(xs->path, PATH_MAX, "%s/%s", dir, tag) >= PATH_MAX - 16) {
+    fprintf(stderr, "Name too long: %s/%s\n", dir, tag);
+    exit(EXIT_FAILURE);
+  }
+  return xs;
+} // xs_init()
+
+static void
+run_name(const extsort_t *xs, int n, char *buf)
+{ /* the file name of run n. xs_init() left room for the suffix. */
+  if (snprintf(buf, PATH_MAX, "%s.%d", xs->path, n) >= PATH_MAX) {
+    fprintf(stderr, "Name too long: %s.%d\n", xs->path, n);
+    exit(EXIT_FAILURE);
+  }
+} // run_name()
+
+void
+xs_add(extsort_t *xs, const void *rec)
+{ /* take one more record. */
+  if (xs->n == xs->cap) spill(xs);
+  memcpy(xs->buf + xs->n * xs->how->size, rec, xs->how->size);
+  xs->n++;
+} // xs_add()
+
+static void
+spill(extsort_t *xs)
+{ /* Sort the buffer and write it out as a new run, merging the runs
+   * already written into one first if there are too many of them.
+  */
+  char name[PATH_MAX];
+  size_t size = xs->how->size;
+  if (xs->seq - xs->first == XS_MAXWAY) {
+    open_runs(xs);
+    run_name(xs, xs->seq, name);
+    FILE *fpo = dofopen(name, "w");
+    char *rec = xmalloc(size);
+    while (pop(xs, rec)) {
+      if (fwrite(rec, size, 1, fpo) != 1) {
+        perror(name);
+        exit(EXIT_FAILURE);
+      }
+    }
+    free(rec);
+    dofclose(fpo);
+    close_runs(xs);
+    xs->first = xs->seq++;
+  }
+  rsort(xs->buf, xs->n, xs->how, xs->nthreads);
+  run_name(xs, xs->seq++, name);
+  FILE *fpo = dofopen(name, "w");
+  if (xs->n && fwrite(xs->buf, size, xs->n, fpo) != xs->n) {
+    perror(name);
+    exit(EXIT_FAILURE);
+  }
+  dofclose(fpo);
+  xs->spilled += xs->n;
+  xs->n = 0;
+} // spill()
+
+void
+xs_rewind(extsort_t *xs)
+{ /* All records are in; get ready for xs_next(). If runs were written
+   * the rest of the buffer is spilled too and the buffer released, to
+   * leave the memory for the next stage.
+  */
+  if (xs->seq == xs->first) {
+    rsort(xs->buf, xs->n, xs->how, xs->nthreads);
+    xs->pos = 0;
+    return;
+  }
+  if (xs->n) spill(xs);
+  free(xs->buf);
+  xs->buf = NULL;
+  open_runs(xs);
+} // xs_rewind()
+
+int
+xs_next(extsort_t *xs, void *rec)
+{ /* Copy out the next record in order, returns 0 when there are no
+   * more. */
+  if (xs->buf) {
+    if (xs->pos == xs->n) return 0;
+    memcpy(rec, xs->buf + xs->pos++ * xs->how->size, xs->how->size);
+    return 1;
+  }
+  return pop(xs, rec);
+} // xs_next()
+
+static void
+open_runs(extsort_t *xs)
+{ /* Open every run, read the first record of each and heap them. */
+  int k = xs->seq - xs->first;
+  size_t size = xs->how->size;
+  xs->in = xcalloc(k, sizeof(FILE *));
+  xs->head = xmalloc(k * size);
+  xs->heap = xcalloc(k, sizeof(int));
+  xs->nheap = 0;
+  int i;
+  for (i = 0; i < k; i++) {
+    char name[PATH_MAX];
+    run_name(xs, xs->first + i, name);
+    xs->in[i] = dofopen(name, "r");
+    setvbuf(xs->in[i], NULL, _IOFBF, XS_IOBUF);
+    if (fread(xs->head + i * size, size, 1, xs->in[i]) == 1) {
+      xs->heap[xs->nheap++] = i;
+    }
+  }
+  for (i = xs->nheap / 2 - 1; i >= 0; i--) sift_down(xs, i);
+} // open_runs()
+
+static void
+sift_down(extsort_t *xs, int i)
+{ /* restore the heap below i. */
+  size_t size = xs->how->size;
+  while (1) {
+    int least = i;
+    int l = 2 * i + 1, r = 2 * i + 2;
+    if (l < xs->nheap && xs->how->cmp(xs->head + xs->heap[l] * size,
+                              xs->head + xs->heap[least] * size) < 0) {
+      least = l;
+    }
+    if (r < xs->nheap && xs->how->cmp(xs->head + xs->heap[r] * size,
+                              xs->head + xs->heap[least] * size) < 0) {
+      least = r;
+    }
+    if (least == i) return;
+    int t = xs->heap[i];
+    xs->heap[i] = xs->heap[least];
+    xs->heap[least] = t;
+    i = least;
+  }
+} // sift_down()
+
+static int
+pop(extsort_t *xs, void *rec)
+{ /* the least record of all the runs, 0 if they are exhausted. */
+  if (!xs->nheap) return 0;
+  size_t size = xs->how->size;
+  int i = xs->heap[0];
+  memcpy(rec, xs->head + i * size, size);
+  if (fread(xs->head + i * size, size, 1, xs->in[i]) != 1) {
+    if (ferror(xs->in[i])) {
+      perror("fread");
+      exit(EXIT_FAILURE);
+    }
+    xs->heap[0] = xs->heap[--xs->nheap];
+  }
+  sift_down(xs, 0);
+  return 1;
+} // pop()
+
+static void
+close_runs(extsort_t *xs)
+{ /* close and remove the runs being merged. */
+  int k = xs->seq - xs->first;
+  int i;
+  for (i = 0; i < k; i++) {
+    char name[PATH_MAX];
+    fclose(xs->in[i]);
+    run_name(xs, xs->first + i, name);
+    unlink(name);
+  }
+  free(xs->in);
+  free(xs->head);
+  free(xs->heap);
+  xs->in = NULL;
+  xs->head = NULL;
+  xs->heap = NULL;
+  xs->nheap = 0;
+} // close_runs()
+
+void
+xs_free(extsort_t *xs)
+{ /* release the sorter and remove any runs left. */
+  if (!xs) return;
+  if (xs->in) {
+    close_runs(xs);
+  } else {
+    int n;
+    for (n = xs->first; n < xs->seq; n++) {
+      char name[PATH_MAX];
+      run_name(xs, n, name);
+      unlink(name);
+    }
+  }
+  free(xs->buf);
+  free(xs);
+} // xs_free()
+
+void
+xs_report(const extsort_t *xs, const char *what)
+{ /* tell the user how much went to disk. */
+  if (xs->seq == xs->first) {
+    fprintf(stderr, "%s: %lu records sorted in memory.\n", what, xs->n);
+  } else {
+    fprintf(stderr, "%s: %lu records spilled to %d runs.\n", what,
+            xs->spilled, xs->seq - xs->first);
+  }
+} // xs_report()
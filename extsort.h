@@ -0,0 +1,83 @@
+/*    extsort.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of extsort.[h|c] is to sort more fixed size records than
+ * will fit in a memory budget. Records are gathered into a buffer of
+ * the budgeted size; each time it fills, it is radix sorted, see
+ * rsort.h, and written out as a run file. Reading back is a k-way merge
+ * of the runs. If there are ever XS_MAXWAY runs they are first merged
+ * into one, so the number of files open at once stays bounded. When
+ * everything fits in the buffer nothing is written and the records are
+ * read straight from memory, so callers need only one code path.
+ * */
+
+#ifndef _EXTSORT_H
+#define _EXTSORT_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h>
+#include "str.h"
+#include "files.h"
+#include "rsort.h"
+
+#define XS_MAXWAY 64
+#define XS_IOBUF (256 * 1024) // stdio buffer of each run file.
+
+typedef struct extsort_t {
+  const rsort_t *how;
+  int nthreads;     // for rsort().
+  char *buf;        // records not yet written out.
+  size_t n;
+  size_t cap;
+  char path[PATH_MAX];  // run files are path.N for first <= N < seq.
+  int first;
+  int seq;
+  size_t spilled;   // records written to runs, merges not counted.
+  size_t pos;       // next record of buf when reading from memory.
+  FILE **in;        // the runs being merged,
+  char *head;       // the current record of each,
+  int *heap;        // and a heap of their indexes on those records.
+  int nheap;
+} extsort_t;
+
+extsort_t
+*xs_init(const char *dir, const char *tag, const rsort_t *how,
+         size_t budget, int nthreads);
+
+void
+xs_add(extsort_t *xs, const void *rec);
+
+void
+xs_rewind(extsort_t *xs);
+
+int
+xs_next(extsort_t *xs, void *rec);
+
+void
+xs_free(extsort_t *xs);
+
+void
+xs_report(const extsort_t *xs, const char *what);
+
+#endif
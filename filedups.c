@@ -21,9 +21,11 @@
  * 
  */
 
+#define _GNU_SOURCE 1
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +39,7 @@
 #include <libgen.h>
 #include <errno.h>
 #include <time.h>
+#include <stddef.h>
 
 #include "str.h"
 #include "dirs.h"
@@ -44,15 +47,115 @@
 #include "gopt.h"
 #include "firstrun.h"
 #include "calcmd5.h"
+#include "walk.h"
+#include "uring.h"
+#include "pathstore.h"
+#include "rsort.h"
+#include "sizeidx.h"
+#include "extsort.h"
+#include "extent.h"
+#include "blkdev.h"
+#include "ringhash.h"
+#include "throttle.h"
+#include "lockstep.h"
+
+#define URING_ENTRIES 1024  // statx requests kept in flight.
 
 // structs
-typedef struct filerec_t {
-  char *path;
+typedef struct frlist_t { // file records, one array for each field.
+  uint32_t *path;   // file handle in the path store.
+  ino_t *inode;
+  size_t *size;
+  md5_t *md5;
+  uint64_t *delete; // delete flags, one bit per record.
+} frlist_t;
+
+typedef struct sikey_t {  // sort keys, with the record index.
+  size_t size;
+  ino_t inode;
+  uint32_t idx;
+} sikey_t;
+
+typedef struct ikey_t {
   ino_t inode;
+  uint32_t idx;
+} ikey_t;
+
+typedef struct pkey_t {  // --hdd, see extent_order().
+  uint64_t physical;
+  ino_t inode;
+  uint32_t idx;
+} pkey_t;
+
+typedef struct mkey_t {
+  md5_t md5;
+  ino_t inode;
+  uint32_t idx;
+} mkey_t;
+
+typedef struct irec_t {   // a record spilled by inode, see extsort.h.
+  ikey_t key;             // key.idx is the path handle.
   size_t size;
-  char md5[33];
-  int delete_flag;
-} filerec_t;
+  md5_t md5;              // from the last hash stage.
+} irec_t;
+
+typedef struct drec_t {   // a record spilled by md5sum.
+  mkey_t key;             // key.idx is the path handle.
+  size_t size;
+} drec_t;
+
+/* Memory for one record through the in memory passes: both record
+ * lists, the largest sort key and the gather order. */
+#define FR_BYTES (2 * (sizeof(uint32_t) + sizeof(ino_t) + sizeof(size_t) \
+                  + sizeof(md5_t)) + sizeof(mkey_t) + sizeof(uint32_t))
+
+typedef struct hjob_t {   // files to hash for one stage, see hash_records().
+  struct prgvar_t *pv;
+  int stage;
+  int start;              // records before this already have digests.
+  int n;
+  const uint32_t *path;
+  const ino_t *inode;     // the names of a file are adjacent.
+  const size_t *size;
+  md5_t *md5;             // the digest of the stage before, replaced.
+  char *bad;              // set if the file could not be read.
+} hjob_t;
+
+typedef struct tjob_t {   // --tree-hash, the segments of one file.
+  const char *path;
+  int nseg;
+  int next;               // next segment to claim, atomic access only.
+  md5_t *seg;             // the digest of each segment.
+  int bad;                // set if any segment could not be read.
+  int sparse;             // set for sparse digests of the segments.
+} tjob_t;
+
+#define TREE_SEG (64 << 20)  // bytes of a file hashed as one segment.
+
+typedef struct hpool_t {  // the files of a job on one device.
+  hjob_t *job;
+  uint32_t *runs;         // the first record of each file, in list order.
+  int nruns;
+  int next;               // next run to claim, atomic access only.
+} hpool_t;
+
+#define HASH_CLAIM 16     // files a hashing thread takes at a time.
+#define DEV_MAX 32        // devices with a pool of their own.
+#define RING_DEPTH 32     // files a READ_URING thread has open at once.
+
+typedef struct rwork_t {  // a READ_URING thread's claim on its pool.
+  hpool_t *pool;
+  int k;                  // the next run to hash,
+  int end;                // and the end of the claim.
+} rwork_t;
+#define HASH_BATCH 8192   // records hashed together when spilled.
+
+/* The cost model of lockstep_chunk(). */
+#define LOCK_FILES 3      // files in a group compared side by side,
+#define LOCK_CHUNK (1 << 20)      // bytes read of each at a time,
+#define LOCK_CHUNK_HDD (16 << 20) // or from a spinning disk.
+#define LOCK_SEEK_MS 8    // a seek on a spinning disk,
+#define LOCK_HASH_MBS 400 // and what a thread hashes, MB a second.
 
 typedef struct excl_t {
   char *text;
@@ -60,29 +163,89 @@ typedef struct excl_t {
   int typ;
 } excl_t;
 
+typedef struct size_inode_t {
+  size_t size;
+  ino_t inode;
+  uint32_t path;  // path store handle, STAT_WALK only.
+} si_t;
+
+enum hash_stages { // see stage_digest().
+  HASH_HEAD,
+  HASH_TAIL,
+  HASH_SAMPLE,    // only with --sample.
+  HASH_FULL
+};
+
+enum sample_modes { // --sample.
+  SAMPLE_OFF,
+  SAMPLE_STAGE,   // a stage ahead of HASH_FULL,
+  SAMPLE_ONLY     // or in place of it.
+};
+
+#define SAMPLE_STEP 4   // more blocks sampled each time a size doubles,
+#define SAMPLE_MAX 64   // up to this many.
+
+enum read_modes { // how files are read for hashing.
+  READ_SYNC,      // read() each file in turn, see calcmd5.h.
+  READ_URING      // many files at once through io_uring, see ringhash.h.
+};
+
+enum stat_modes { // how file sizes and inodes are found.
+  STAT_WALK,      // fstatat() relative to the dir during traversal.
+  STAT_PATH,      // stat() each full path after traversal.
+  STAT_URING      // as STAT_PATH, but batched statx() via io_uring.
+};
+
 typedef struct prgvar_t {
   char *dirpath;
-  char *files_list;
-  filerec_t *list1;
-  filerec_t *list2;
+  frlist_t list1;
+  frlist_t list2;
   int lc1;    // record count of list1
   int lc2;    // record count of list2
-  int pages;  /* Max number of blocks of 4096 bytes to calculate
-  * md5sum for a file. If pages < 1 then the entire file size will be
-  * used. */
-  size_t dat_size;  // initial memory allocation for files_list.
-  size_t inc_size;  // If dat_size bytes is too small, add this value.
-  mdata *md;        // describes a block of chars in memory.
+  int pages;  /* Number of blocks of 4096 bytes at the head, and at
+  * the tail, of a file to hash before resorting to the whole file. If
+  * pages < 1 then only the entire file will be used. */
+  pathstore_t *ps;  // the file paths found, in traversal order.
   excl_t *excludes; // a temporary file with d_name lists to exclude.
+  int threads;      // threads for dir traversal and sorting.
+  int hash_threads; // threads for hashing files.
+  int hdd;          // --hdd, hash in order of the data on disk.
+  int read_mode;    // one of enum read_modes.
+  tb_t *read_tb;    // --max-read, bytes a second, or NULL.
+  tb_t *stat_tb;    // --max-stat, stats a second, or NULL.
+  dev_t devs[DEV_MAX];  // the devices files are hashed from,
+  int streams[DEV_MAX]; // and the hashing threads for each.
+  char rotating[DEV_MAX]; // set for a spinning disk.
+  int ndevs;
+  int8_t *dirdev;       // index into devs of each path store dir, or
+  uint32_t dirdev_cap;  // -1 if not yet known.
+  int stat_mode;    // one of enum stat_modes.
+  si_t *stats;      // files found by STAT_WALK sharing a size, lc1 of
+  int stats_cap;    // them.
+  sizeidx_t *sizes; // sizes seen by STAT_WALK.
+  szcount_t *counts;  // --low-memory, sizes seen by the first pass.
+  pthread_mutex_t count_lock;
+  int pass;           // 1 while counting sizes, else 2.
+  size_t seen_files;  // files counted by the first pass,
+  size_t seen_bytes;  // and the bytes of their names.
+  size_t kept_bytes;  // bytes of names kept by the second pass.
+  size_t max_memory;  // --max-memory, 0 for no limit.
+  extsort_t *spill;   // records by size and inode, once over budget.
+  char spilldir[PATH_MAX];  // where the runs go.
+  int dont_sync;    // STAT_URING may use AT_STATX_DONT_SYNC.
+  int lockstep;     // --lockstep, most files of a size compared whole.
+  size_t tree_size; // --tree-hash, files this big get a tree digest.
+  size_t sparse_size; // --sparse, and these get a sparse digest.
+  int sample;       // one of enum sample_modes.
+  frlist_t settled; // records given their digest by lockstep(),
+  int nsettled;     // kept out of the hash stages.
 } prgvar_t;
 
-typedef struct size_inode_t {
-  size_t size;
-  ino_t inode;
-} si_t;
-
 // Globals
 static char *vsn;
+// delete flags
+#define isdeleted(fl, i) (((fl)->delete[(i) / 64] >> ((i) % 64)) & 1)
+#define setdeleted(fl, i) ((fl)->delete[(i) / 64] |= 1ULL << ((i) % 64))
 // headers
 static void
 dohelp(int forced);
@@ -101,6 +264,31 @@ validate_input(const char *path);
 static void
 fdrecursedir(const char *dirname, prgvar_t *pv);
 static int
+fdexclude(const char *dname, void *arg);
+static unsigned
+fddir(unsigned parent, const char *name, void *arg);
+static void
+fdrecord(unsigned dir, const char *name, const wstat_t *st, void *arg);
+static void
+keep_stat(prgvar_t *pv, size_t size, const szrec_t *rec);
+static int
+fdcount(const char *name, const wstat_t *st, void *arg);
+static int
+fdrepeated(const char *name, const wstat_t *st, void *arg);
+static void
+low_memory_report(prgvar_t *pv);
+static void
+throttle_report(prgvar_t *pv);
+static size_t
+parse_bytes(const char *s);
+static void
+start_spill(prgvar_t *pv);
+static void
+external_duplicates(prgvar_t *pv);
+static void
+put_record(FILE *fpo, prgvar_t *pv, const md5_t *md5, ino_t inode,
+           size_t size, uint32_t path);
+static int
 dname_test(const excl_t *exclude_these, const char *dname);
 static void
 make_filerecord_list(prgvar_t *pv);
@@ -108,6 +296,8 @@ static void
 make_files_list(prgvar_t *pv);
 static si_t
 *get_size_inode(const char *p);
+static int
+uring_size_inode(prgvar_t *pv);
 static void
 delete_unique_size_file_records(prgvar_t *pv);
 static int
@@ -115,13 +305,75 @@ cmpinodep(const void *p1, const void *p2);
 static int
 cmpsize_inodep(const void *p1, const void *p2);
 static void
-mem_append(const char *p, prgvar_t *pv);
-static size_t
-str_sizes_to_number(const char *strnum);
+frlist_alloc(frlist_t *fl, int n);
+static void
+frlist_free(frlist_t *fl);
+static void
+frlist_gather(frlist_t *to, const frlist_t *fro, const uint32_t *order,
+              int n);
 static void
 delete_groups_of_files_sharing_size_and_inode(prgvar_t *pv);
 static void
-calcmd5sums(filerec_t *list, int lc, int pages);
+compare_in_lockstep(prgvar_t *pv);
+static size_t
+lockstep_chunk(prgvar_t *pv, int n, size_t size, int rotating);
+static int
+restore_settled(prgvar_t *pv);
+static void
+calcmd5sums(prgvar_t *pv, frlist_t *list, int lc, int stage, int start);
+static int
+stage_digest(prgvar_t *pv, c5batch_t *batch, const char *path,
+             size_t size, int stage, md5_t *md5);
+static int
+stage_request(prgvar_t *pv, size_t size, int stage, const md5_t *md5,
+              rhreq_t *rq);
+static int
+last_stage(prgvar_t *pv, int stage);
+static int
+next_stage(prgvar_t *pv, int stage);
+static int
+sample_count(prgvar_t *pv, size_t size);
+static const char
+*digest_label(prgvar_t *pv, size_t size);
+static void
+hash_records(hjob_t *job);
+static int
+whole_stage(prgvar_t *pv, size_t size, int stage);
+static int
+tree_stage(prgvar_t *pv, size_t size, int stage);
+static int
+sparse_stage(prgvar_t *pv, size_t size, int stage);
+static void
+tree_records(hjob_t *job);
+static int
+tree_digest(const char *path, size_t size, int threads, int sparse,
+            md5_t *md5);
+static void
+*tree_worker(void *p);
+static void
+*hash_worker(void *p);
+static int
+record_device(prgvar_t *pv, uint32_t path);
+static void
+prefetch_record(hjob_t *job, int i);
+static int
+ring_worker(hpool_t *pool);
+static int
+ring_next(rhreq_t *rq, void *arg);
+static void
+ring_done(const rhreq_t *rq, void *arg);
+static void
+sort_by_inode(prgvar_t *pv);
+static void
+extent_order(prgvar_t *pv, const uint32_t *path, const ino_t *inode,
+             int n, uint32_t *order);
+static void
+sort_by_extent(prgvar_t *pv);
+static void
+permute(void *base, size_t width, const uint32_t *order, int n,
+        void *tmp);
+static int
+cmpphysp(const void *p1, const void *p2);
 static int
 cmpmd5p(const void *p1, const void *p2);
 static void
@@ -133,6 +385,22 @@ static char
 static excl_t
 *compile_excludes(const char *progname);
 
+// How the radix sort finds the key words of each kind of sort key.
+static const rsort_t sikey_sort = { sizeof(struct sikey_t), 2,
+  { offsetof(sikey_t, size), offsetof(sikey_t, inode) }, cmpsize_inodep };
+static const rsort_t ikey_sort = { sizeof(struct ikey_t), 1,
+  { offsetof(ikey_t, inode) }, cmpinodep };
+static const rsort_t pkey_sort = { sizeof(struct pkey_t), 2,
+  { offsetof(pkey_t, physical), offsetof(pkey_t, inode) }, cmpphysp };
+static const rsort_t mkey_sort = { sizeof(struct mkey_t), 3,
+  { offsetof(mkey_t, md5.w[0]), offsetof(mkey_t, md5.w[1]),
+    offsetof(mkey_t, inode) }, cmpmd5p };
+// The spilled records lead with a key, so the comparisons still apply.
+static const rsort_t irec_sort = { sizeof(struct irec_t), 1,
+  { offsetof(irec_t, key.inode) }, cmpinodep };
+static const rsort_t drec_sort = { sizeof(struct drec_t), 3,
+  { offsetof(drec_t, key.md5.w[0]), offsetof(drec_t, key.md5.w[1]),
+    offsetof(drec_t, key.inode) }, cmpmd5p };
 
 int main(int argc, char **argv)
 { /* main */
@@ -143,22 +411,38 @@ int main(int argc, char **argv)
   char thepath[PATH_MAX];
   pv->lc1 = 0;  // redundant.
   int i;
-  if (argc == 1) {
-    pv->dirpath = realpath("./", thepath);
-    make_files_list(pv);
-    printf("%s\n", pv->dirpath);
-  } else for (i = 1; argv[i] ; i++) {
-    pv->dirpath = realpath(argv[i], thepath);
-    validate_input(thepath);
-    make_files_list(pv);
-    printf("%s\n", pv->dirpath);
-  }
+  for ( ; pv->pass <= 2; pv->pass++) { // --low-memory starts at 1.
+    if (optind == argc) { // getopt_long() has moved any dirs to the end.
+      pv->dirpath = realpath("./", thepath);
+      make_files_list(pv);
+      if (pv->pass == 2) printf("%s\n", pv->dirpath);
+    } else for (i = optind; argv[i] ; i++) {
+      pv->dirpath = realpath(argv[i], thepath);
+      validate_input(thepath);
+      make_files_list(pv);
+      if (pv->pass == 2) printf("%s\n", pv->dirpath);
+    }
+  } // for(pass...)
   make_filerecord_list(pv);
+  if (pv->spill) { // over the --max-memory budget.
+    external_duplicates(pv);
+    throttle_report(pv);
+    return 0;
+  }
   delete_unique_size_file_records(pv);
   delete_groups_of_files_sharing_size_and_inode(pv);
-  calcmd5sums(pv->list1, pv->lc1, pv->pages); // list1; last used list.
-  delete_unique_md5sum_records(pv);
+  if (pv->lockstep > 1) compare_in_lockstep(pv);
+  int stage, start = 0;
+  for (stage = HASH_HEAD; ; stage = next_stage(pv, stage)) {
+    if (pv->hdd) sort_by_extent(pv);
+    if (last_stage(pv, stage)) start = restore_settled(pv);
+    calcmd5sums(pv, &pv->list1, pv->lc1, stage, start); // list1; last used.
+    delete_unique_md5sum_records(pv);
+    if (last_stage(pv, stage)) break;
+    sort_by_inode(pv);
+  }
   serialise_duplicate_records(pv);
+  throttle_report(pv);
 
   // free the files data block.
   return 0;
@@ -205,9 +489,11 @@ free_prgvar_t(prgvar_t *pv)
 { /* frees the objects built on the heap. */
   if (!pv) return;
   if (pv->dirpath) free(pv->dirpath);
-  if (pv->files_list) free(pv->files_list);
-  if (pv->list1) free(pv->list1);
-  if (pv->list2) free(pv->list2);
+  if (pv->ps) ps_free(pv->ps);
+  frlist_free(&pv->list1);
+  frlist_free(&pv->list2);
+  frlist_free(&pv->settled);
+  free(pv->dirdev);
   free(pv);
 } // free_prgvar_t()
 
@@ -220,24 +506,106 @@ setup_program(options_t *opt, int argc, char **argv, prgvar_t *pv)
   if (opt->runhelp) dohelp(0); // will exit.
   if (opt->runvsn) dovsn(); // will exit.
   is_this_first_run();
-  /* data size has been set from read_config(), alter these settings,
-   * alter these settings if options require it.
-  */
-  size_t od = str_sizes_to_number(opt->dat_size);
-  if (od) pv->dat_size = od;
-  od = str_sizes_to_number(opt->dat_incr);
-  if (od) pv->inc_size = od;
-  /* regardless of how the data size and it's increment were set,
-   * ensure that they are set to a memory page boundary. */
-  size_t adjust = pv->dat_size % 4096;
-  if (adjust) pv->dat_size += (4096 - adjust);
-  adjust = pv->inc_size % 4096;
-  if (adjust) pv->inc_size += (4096 - adjust);
-  static mdata md;
-  md.fro = xcalloc(pv->dat_size, 1);
-  md.limit = md.fro + pv->dat_size;
-  md.to = md.fro; // data block is empty.
-  pv->md = &md;
+  if (opt->threads > 0) pv->threads = opt->threads;
+  if (opt->hash_threads > 0) pv->hash_threads = opt->hash_threads;
+  pv->hdd = opt->hdd;
+  if (opt->block_size[0]) calcmd5_blocksize(parse_bytes(opt->block_size));
+  if (opt->read_mode[0]) {
+    if (strcmp(opt->read_mode, "sync") == 0) {
+      pv->read_mode = READ_SYNC;
+    } else if (strcmp(opt->read_mode, "uring") == 0) {
+      pv->read_mode = READ_URING;
+    } else {
+      fprintf(stderr, "Unknown read mode: %s\n", opt->read_mode);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (opt->ioprio[0] && set_ioprio(opt->ioprio) == -1) {
+    fprintf(stderr, "Can not set io priority %s: %s\n", opt->ioprio,
+            strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (opt->nice && set_nice(opt->nice) == -1) {
+    perror("nice");
+    exit(EXIT_FAILURE);
+  }
+  if (opt->max_read[0]) {
+    pv->read_tb = tb_init(parse_bytes(opt->max_read));
+    calcmd5_throttle(pv->read_tb);
+    ringhash_throttle(pv->read_tb);
+    lockstep_throttle(pv->read_tb);
+  }
+  if (opt->max_stat > 0) pv->stat_tb = tb_init(opt->max_stat);
+  if (opt->lockstep_given) {
+    if (opt->lockstep > LOCKSTEP_MAX) {
+      fprintf(stderr, "--lockstep may be no more than %d.\n",
+              LOCKSTEP_MAX);
+      exit(EXIT_FAILURE);
+    }
+    pv->lockstep = opt->lockstep;
+  }
+  if (opt->cache_neutral) {
+    if (pv->read_mode != READ_SYNC) {
+      fputs("--cache-neutral needs --read-mode sync.\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+    calcmd5_cachemode((opt->cache_neutral == 2)
+                      ? CALC_NEUTRAL | CALC_DIRECT : CALC_NEUTRAL);
+    pv->lockstep = 0; // its reads go through the cache.
+  }
+  pv->dont_sync = opt->dont_sync;
+  if (opt->stat_mode[0]) {
+    if (strcmp(opt->stat_mode, "walk") == 0) {
+      pv->stat_mode = STAT_WALK;
+    } else if (strcmp(opt->stat_mode, "path") == 0) {
+      pv->stat_mode = STAT_PATH;
+    } else if (strcmp(opt->stat_mode, "uring") == 0) {
+      pv->stat_mode = STAT_URING;
+    } else {
+      fprintf(stderr, "Unknown stat mode: %s\n", opt->stat_mode);
+      exit(EXIT_FAILURE);
+    }
+  }
+  pv->ps = ps_init(opt->hugepages);
+  if (pv->stat_mode == STAT_WALK) pv->sizes = szx_init();
+  if (opt->pages_given) pv->pages = opt->pages;
+  int algo = ALGO_MD5;
+  if (opt->hash[0]) {
+    algo = hash_byname(opt->hash);
+    if (algo == -1) {
+      fprintf(stderr, "Unknown hash: %s\n", opt->hash);
+      exit(EXIT_FAILURE);
+    }
+  }
+  hash_select(algo);  // picks the vector code, for MD5 too.
+  if (opt->hash[0]) fprintf(stderr, "Hashing with %s.\n", hash_describe());
+  if (opt->kernel_hash) {
+    if (hash_selected() != ALGO_MD5) {
+      fputs("--kernel-hash is for md5 only.\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+    if (calcmd5_kernel() == -1) {
+      fprintf(stderr, "Kernel md5 is not available (%s), hashing in user"
+              " space.\n", strerror(errno));
+    } else {
+      fputs("Hashing md5 in the kernel.\n", stderr);
+    }
+  }
+  if (opt->max_memory[0]) pv->max_memory = parse_bytes(opt->max_memory);
+  if (opt->tree_hash[0]) pv->tree_size = parse_bytes(opt->tree_hash);
+  if (opt->sparse[0]) pv->sparse_size = parse_bytes(opt->sparse);
+  pv->sample = opt->sample;
+  if (pv->sample == SAMPLE_ONLY) pv->lockstep = 0;  // it reads all.
+  pv->pass = 2;
+  if (opt->low_memory) {
+    if (pv->stat_mode != STAT_WALK) {
+      fputs("--low-memory needs --stat-mode walk.\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+    pv->counts = szc_init();
+    pthread_mutex_init(&pv->count_lock, NULL);
+    pv->pass = 1;
+  }
 } // setup_program()
 
 static void
@@ -252,36 +620,128 @@ validate_input(const char *p)
 
 static void
 fdrecursedir(const char *path, prgvar_t *pv)
-{ /* Record eligible files in a block of memory. */
-  DIR *dp = opendir(path);
-  if (!dp) {
-    perror(path);
-    exit(EXIT_FAILURE);
-  }
-  struct dirent *de;
-  while ((de = readdir(dp))) {
-    if (strcmp(de->d_name, ".") == 0 ) continue;
-    if (strcmp(de->d_name, "..") == 0) continue;
-    if (dname_test(pv->excludes, de->d_name) == 0) continue;
-    char joinbuf[PATH_MAX];
-    strcpy(joinbuf, path);
-    strcat(joinbuf, "/");
-    strcat(joinbuf, de->d_name);
-    switch (de->d_type) {
-    case DT_DIR:
-      fdrecursedir(joinbuf, pv);
-      break;
-    case DT_REG:
-      mem_append(joinbuf, pv);
-      pv->lc1++;
-      break;
-    default:
-      break;  // no interest in anything except regular files and dirs.
-    } // switch()
-  } // while()
-  closedir(dp);
+{ /* Record eligible files in the path store. The tree is read by
+   * pv->threads workers, see walk.c; the paths arrive back here in
+   * the same order whatever the thread count.
+  */
+  int flags = (pv->stat_mode == STAT_WALK) ? WALK_STAT : 0;
+  walk_t *w = walk_init(pv->threads, flags, fdexclude, pv);
+  if (pv->counts) walk_set_keep(w, (pv->pass == 1) ? fdcount : fdrepeated);
+  walk_set_throttle(w, pv->stat_tb);
+  walk_run(w, path, fddir, fdrecord, pv);
+  walk_free(w);
 } // fdrecursedir()
 
+static int
+fdexclude(const char *dname, void *arg)
+{ /* walker callback, non-zero if dname_test() rejects the d_name. */
+  prgvar_t *pv = arg;
+  return dname_test(pv->excludes, dname) == 0;
+} // fdexclude()
+
+static unsigned
+fddir(unsigned parent, const char *name, void *arg)
+{ /* walker callback, keep a dir that has files. */
+  prgvar_t *pv = arg;
+  return ps_add_dir(pv->ps, parent, name);
+} // fddir()
+
+static void
+fdrecord(unsigned dir, const char *name, const wstat_t *st, void *arg)
+{ /* walker callback, keep a regular file's name, and its size and
+   * inode if the walker found them.
+   * When the size is known a file is only counted into list1 once some
+   * other file has the same size; until then the size index holds it.
+   * Empty files are never counted.
+  */
+  prgvar_t *pv = arg;
+  uint32_t file = ps_add_file(pv->ps, dir, name);
+  pv->kept_bytes += strlen(name) + 1;
+  if (!st) {
+    pv->lc1++;
+    return;
+  }
+  if (st->size == 0) return;
+  szrec_t rec = { file, st->inode };
+  szrec_t first;
+  uint32_t count = szx_add(pv->sizes, st->size, &rec, &first);
+  if (count == 2) keep_stat(pv, st->size, &first);
+  if (count >= 2) keep_stat(pv, st->size, &rec);
+} // fdrecord()
+
+static void
+keep_stat(prgvar_t *pv, size_t size, const szrec_t *rec)
+{ /* append a file that shares its size to pv->stats, or to the spill
+   * once the records would be over budget. */
+  if (pv->max_memory && !pv->spill &&
+      (size_t)(pv->lc1 + 1) * FR_BYTES > pv->max_memory) start_spill(pv);
+  if (pv->spill) {
+    sikey_t k = { size, rec->inode, rec->file };
+    xs_add(pv->spill, &k);
+    pv->lc1++;
+    return;
+  }
+  if (pv->lc1 == pv->stats_cap) {
+    pv->stats_cap = (pv->stats_cap) ? 2 * pv->stats_cap : 4096;
+    pv->stats = realloc(pv->stats, pv->stats_cap * sizeof(si_t));
+    if (!pv->stats) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  pv->stats[pv->lc1].size = size;
+  pv->stats[pv->lc1].inode = rec->inode;
+  pv->stats[pv->lc1].path = rec->file;
+  pv->lc1++;
+} // keep_stat()
+
+static int
+fdcount(const char *name, const wstat_t *st, void *arg)
+{ /* walker keep callback for the first --low-memory pass; count the
+   * size and keep nothing. Runs in the walker's threads.
+  */
+  prgvar_t *pv = arg;
+  pthread_mutex_lock(&pv->count_lock);
+  if (st->size) szc_add(pv->counts, st->size);
+  pv->seen_files++;
+  pv->seen_bytes += strlen(name) + 1;
+  pthread_mutex_unlock(&pv->count_lock);
+  return 0;
+} // fdcount()
+
+static int
+fdrepeated(const char *name, const wstat_t *st, void *arg)
+{ /* walker keep callback for the second --low-memory pass; keep only
+   * files whose size the first pass saw more than once.
+  */
+  (void)name;
+  prgvar_t *pv = arg;
+  return szc_multi(pv->counts, st->size);
+} // fdrepeated()
+
+static void
+throttle_report(prgvar_t *pv)
+{ /* What --max-read and --max-stat held back, for tuning them. */
+  tb_report(pv->stat_tb, "Stat", "stats");
+  tb_report(pv->read_tb, "Read", "bytes");
+} // throttle_report()
+
+static void
+low_memory_report(prgvar_t *pv)
+{ /* Tell the user what the first pass saved: the names and path store
+   * entries of the files that were not kept.
+  */
+  size_t dropped = pv->seen_files - pv->ps->nfiles;
+  fprintf(stderr, "Low memory: %lu of %lu files kept, %lu bytes of "
+          "paths not stored, %lu bytes of size counts.\n",
+          (size_t)pv->ps->nfiles, pv->seen_files,
+          pv->seen_bytes - pv->kept_bytes + dropped * sizeof(psfile_t),
+          szc_bytes(pv->counts));
+  szc_free(pv->counts);
+  pv->counts = NULL;
+  pthread_mutex_destroy(&pv->count_lock);
+} // low_memory_report()
+
 static int
 dname_test(const excl_t *excl_these, const char *dname)
 { /* Test d_names against a list of names to exclude.
@@ -332,28 +792,58 @@ dname_test(const excl_t *excl_these, const char *dname)
 
 static void
 make_files_list(prgvar_t *pv)
-{ /* writes file paths to a block of memory as C strings. */
+{ /* writes file paths to the path store. */
   fdrecursedir(pv->dirpath, pv);
 } // make_files_list()
 
 static void
 make_filerecord_list(prgvar_t *pv)
-{ /* The files to consider for duplication are recorded in a file;
-   * they are to be included into a list of file records.
-   * Returning the mdata pointer allows the data block to be free'd.
+{ /* The files to consider for duplication are recorded in the path
+   * store; they are to be included into a list of file records, each
+   * holding the handle of its path.
+   * With STAT_WALK the sizes and inodes are already known, and only
+   * the files sharing a size were counted; otherwise each path is
+   * stat()ed now.
   */
-  pv->list1 = xcalloc(pv->lc1, sizeof(struct filerec_t));
-  char *cp = pv->md->fro;
+  if (pv->stat_mode == STAT_URING && !uring_size_inode(pv)) {
+    fputs("io_uring is not available, using stat().\n", stderr);
+  }
+  ps_report(pv->ps);
+  if (pv->counts) low_memory_report(pv);
+  if (pv->sizes) {
+    szx_report(pv->sizes, pv->lc1);
+    szx_free(pv->sizes);
+    pv->sizes = NULL;
+  }
   int i;
+  int statted = (pv->stats || pv->stat_mode == STAT_WALK);
+  if (pv->max_memory && !pv->spill &&
+      (size_t)pv->lc1 * FR_BYTES > pv->max_memory) start_spill(pv);
+  if (pv->spill) {
+    for (i = 0; i < pv->lc1 && !statted; i++) {
+      char buf[PATH_MAX];
+      tb_take(pv->stat_tb, 1);
+      si_t *sit = get_size_inode(ps_path(pv->ps, i, buf));
+      if (!sit) continue;
+      sikey_t k = { sit->size, sit->inode, i };
+      xs_add(pv->spill, &k);
+    }
+    return;
+  }
+  frlist_alloc(&pv->list1, pv->lc1);
   for (i = 0; i < pv->lc1; i++) {
-    si_t *sit = get_size_inode(cp);
+    char buf[PATH_MAX];
+    if (!pv->stats) tb_take(pv->stat_tb, 1);
+    si_t *sit = (pv->stats) ? &pv->stats[i]
+                            : get_size_inode(ps_path(pv->ps, i, buf));
+    pv->list1.path[i] = (pv->stats) ? pv->stats[i].path : (uint32_t)i;
     if (sit) { // possibly file has gone AWL.
-      pv->list1[i].path = cp;
-      pv->list1[i].inode = sit->inode;
-      pv->list1[i].size = sit->size;
-      cp += strlen(cp) + 1;
+      pv->list1.inode[i] = sit->inode;
+      pv->list1.size[i] = sit->size;
     } // if()
   } // for()
+  free(pv->stats);
+  pv->stats = NULL;
 } // file_data_to_list()
 
 static si_t
@@ -374,49 +864,124 @@ static si_t
   return &sit;
 } // get_size_inode()
 
+static int
+uring_size_inode(prgvar_t *pv)
+{ /* Fill pv->stats for every path in the path store using statx()
+   * requests submitted through io_uring, URING_ENTRIES at a time.
+   * Only the size and inode are asked for. A file that has disappeared
+   * is reported and recorded as zero length, so it drops out with the
+   * other empty files. Returns 0, with nothing done, if the kernel can
+   * not supply a ring; a kernel which has io_uring without statx gets
+   * each path stat()ed as its request fails.
+  */
+  uring_t *r = uring_init(URING_ENTRIES);
+  if (!r) return 0;
+  unsigned slots = URING_ENTRIES;
+  struct statx *stx = xcalloc(slots, sizeof(struct statx));
+  char (*paths)[PATH_MAX] = xcalloc(slots, PATH_MAX);
+  int *recno = xcalloc(slots, sizeof(int));
+  unsigned *freeslot = xcalloc(slots, sizeof(unsigned));
+  unsigned nfree, k;
+  for (k = 0; k < slots; k++) freeslot[k] = k;
+  nfree = slots;
+  int flags = (pv->dont_sync) ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT;
+  pv->stats = xcalloc(pv->lc1, sizeof(si_t));
+  int next = 0, inflight = 0;
+  while (next < pv->lc1 || inflight) {
+    while (next < pv->lc1 && nfree && uring_space(r)) {
+      unsigned slot = freeslot[--nfree];
+      tb_take(pv->stat_tb, 1);
+      char *cp = ps_path(pv->ps, next, paths[slot]);
+      pv->stats[next].path = next;
+      struct io_uring_sqe *sqe = uring_get_sqe(r);
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (unsigned long)cp;
+      sqe->len = STATX_SIZE | STATX_INO;
+      sqe->off = (unsigned long)&stx[slot];
+      sqe->statx_flags = flags;
+      sqe->user_data = slot;
+      recno[slot] = next;
+      next++;
+      inflight++;
+    } // while(filling)
+    // what the kernel does not take now goes again on the next pass.
+    if (uring_submit(r, 1) == -1) {
+      perror("io_uring_enter");
+      exit(EXIT_FAILURE);
+    }
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(r))) {
+      unsigned slot = cqe->user_data;
+      int res = cqe->res;
+      uring_cqe_seen(r);
+      si_t *sit = &pv->stats[recno[slot]];
+      if (res == 0) {
+        sit->size = stx[slot].stx_size;
+        sit->inode = stx[slot].stx_ino;
+      } else if (res == -EINVAL || res == -EOPNOTSUPP) {
+        si_t *sync = get_size_inode(paths[slot]); // statx op unknown.
+        if (sync) {
+          sit->size = sync->size;
+          sit->inode = sync->inode;
+        }
+      } else {
+        fprintf(stderr, "File dissappeared: %s\n", paths[slot]);
+      }
+      freeslot[nfree++] = slot;
+      inflight--;
+    } // while(reaping)
+  } // while()
+  free(freeslot);
+  free(recno);
+  free(paths);
+  free(stx);
+  uring_free(r);
+  return 1;
+} // uring_size_inode()
+
 static void
 delete_unique_size_file_records(prgvar_t *pv)
 { /* sort the list of file records on size and delete those having
    * singular size.
+   * The sort works on a compact array of keys, radix sorted by
+   * pv->threads threads; the records themselves are then gathered into
+   * pv->list2 in key order.
   */
-  qsort(pv->list1, pv->lc1, sizeof(struct filerec_t), cmpsize_inodep);
-  if (pv->list1[0].size != pv->list1[1].size)
-    pv->list1[0].delete_flag = 1;
+  sikey_t *keys = xcalloc(pv->lc1, sizeof(struct sikey_t));
   int i;
-  for (i = 1; i < pv->lc1-1; i++) {
-    if (pv->list1[i].size != pv->list1[i-1].size &&
-        pv->list1[i].size != pv->list1[i+1].size) {
-      pv->list1[i].delete_flag = 1;
-    }
-  } // for(i...)
-  if (pv->list1[pv->lc1-1].size != pv->list1[pv->lc1-2].size)
-    pv->list1[pv->lc1-1].delete_flag = 1;
-  /* Now count the records to retain, those with size > 0, and have
-   * delete flag not set. */
+  for (i = 0; i < pv->lc1; i++) {
+    keys[i].size = pv->list1.size[i];
+    keys[i].inode = pv->list1.inode[i];
+    keys[i].idx = i;
+  }
+  rsort(keys, pv->lc1, &sikey_sort, pv->threads);
+  /* Records to retain have size > 0 and share their size with at least
+   * one neighbour. */
+  uint32_t *order = xcalloc(pv->lc1, sizeof(uint32_t));
   pv->lc2 = 0;
   for (i = 0; i < pv->lc1; i++) {
-    if (pv->list1[i].size > 0 && pv->list1[i].delete_flag == 0)
-      pv->lc2++;
+    if (keys[i].size == 0) continue;
+    if ((i > 0 && keys[i].size == keys[i-1].size) ||
+        (i < pv->lc1-1 && keys[i].size == keys[i+1].size)) {
+      order[pv->lc2++] = keys[i].idx;
+    }
   } // for(i...)
+  free(keys);
   /* Records are in order of size, and inode as a secondary key. These
    * records will be placed in a second list, pv->list2 for further
    * action.
   */
-  pv->list2 = xcalloc(pv->lc2, sizeof(struct filerec_t));
-  int j = 0;
-  for (i = 0; i < pv->lc1; i++) {
-    if (pv->list1[i].size > 0 && pv->list1[i].delete_flag == 0) {
-      pv->list2[j] = pv->list1[i];
-      j++;
-    } // if()
-  } // for()
+  frlist_alloc(&pv->list2, pv->lc2);
+  frlist_gather(&pv->list2, &pv->list1, order, pv->lc2);
+  free(order);
 } // delete_unique_size_file_records()
 
 static int
 cmpinodep(const void *p1, const void *p2)
 {
-  filerec_t *frp1 = (filerec_t *)p1;
-  filerec_t *frp2 = (filerec_t *)p2;
+  ikey_t *frp1 = (ikey_t *)p1;
+  ikey_t *frp2 = (ikey_t *)p2;
 
   /* I can not just rely on a simple subtaction because I am operating
    * on 8 byte numbers which can generate results that overflow an int.
@@ -432,8 +997,8 @@ cmpinodep(const void *p1, const void *p2)
 static int
 cmpsize_inodep(const void *p1, const void *p2)
 { /* Will treat the inode number as a second place key. */
-  filerec_t *frp1 = (filerec_t *)p1;
-  filerec_t *frp2 = (filerec_t *)p2;
+  sikey_t *frp1 = (sikey_t *)p1;
+  sikey_t *frp2 = (sikey_t *)p2;
 
   /* I can not just rely on a simple subtaction because I am operating
    * on 8 byte numbers which can generate results that overflow an int.
@@ -457,70 +1022,52 @@ static prgvar_t
 { /* presently this is just a bullshit placeholder that acts as if it
    * really did read a config file. */
   static prgvar_t pv = {0};
-  static mdata md;
   char *exclfile = prepare_excludes("filedups");
   pv.excludes = compile_excludes(exclfile);
-  pv.dat_size = 1024 * 1024;  // 1 meg so far;
-  pv.inc_size = pv.dat_size / 10; // may be replaced by options.
   pv.pages = 1; // option can vary this.
-  pv.md = &md;
+  pv.threads = walk_default_threads(); // option can vary this.
+  pv.hash_threads = pv.threads; // option can vary this.
+  pv.stat_mode = STAT_WALK; // option can vary this.
+  pv.lockstep = LOCK_FILES; // option can vary this.
   return &pv;
 } // read_config()
 
-void
-mem_append(const char *p, prgvar_t *pv)
-{ /* appends a C string to a memory block, taking care of memory
-   * re-sizing as required. I build in an 8 byte safety margin before
-   * invoking a realloc() operation.
-  * */
-  size_t len = strlen(p);
-  size_t available = pv->md->limit - pv->md->to;
-  if ( len + 8 > available) { // realloc() required
-    size_t addon = pv->inc_size;
-    while (len + 8 > addon) addon += len; // not likely, but be sure.
-    // record current block parameters
-    char *fro = pv->md->fro;
-    char *to = pv->md->to;
-    char *limit = pv->md->limit;
-    size_t newsize = limit - fro + addon;
-    pv->md->fro = realloc(fro, newsize);
-    if (pv->md->fro != fro) {
-      off_t locdiff = pv->md->fro - fro;
-      to += locdiff;
-      limit += locdiff;
-    }
-    memset(limit, 0, addon);
-    limit += addon;
-    pv->md->to = to;
-    pv->md->limit = limit;
-  }
-  strcpy(pv->md->to, p);
-  pv->md->to += len + 1;
-} // mem_append()
+static void
+frlist_alloc(frlist_t *fl, int n)
+{ /* room for n records, each field in its own array. */
+  size_t cap = (n) ? n : 1;
+  fl->path = xcalloc(cap, sizeof(uint32_t));
+  fl->inode = xcalloc(cap, sizeof(ino_t));
+  fl->size = xcalloc(cap, sizeof(size_t));
+  fl->md5 = xcalloc(cap, sizeof(md5_t));
+  fl->delete = xcalloc((cap + 63) / 64, sizeof(uint64_t));
+} // frlist_alloc()
 
-static size_t
-str_sizes_to_number(const char *strnum)
-{ /* convert strings of human readable form to size_t, eg 1M, 100K...*/
-  size_t num = strtoul(strnum, NULL, 10);
-  size_t len = strlen(strnum);
-  char modifier = strnum[len-1];  // last char
-  size_t mul;
-  switch (modifier) {
-    case 'k':
-    case 'K':
-      mul = 1024;
-      break;
-    case 'm': case 'M':
-      mul = 1024 * 1024;
-      break;
-    case 'g': case 'G':
-      mul = 1024 * 1024 * 1024;
-      break;
-    default:
-      mul = 1;
-  }
-  return mul * num;
-} // str_sizes_to_number()
+static void
+frlist_free(frlist_t *fl)
+{ /* release the arrays of a record list. */
+  free(fl->path);
+  free(fl->inode);
+  free(fl->size);
+  free(fl->md5);
+  free(fl->delete);
+  memset(fl, 0, sizeof(struct frlist_t));
+} // frlist_free()
+
+static void
+frlist_gather(frlist_t *to, const frlist_t *fro, const uint32_t *order,
+              int n)
+{ /* to[i] = fro[order[i]] for i < n, the lists must not be the same. */
+  int i;
+  for (i = 0; i < n; i++) to->path[i] = fro->path[order[i]];
+  for (i = 0; i < n; i++) to->inode[i] = fro->inode[order[i]];
+  for (i = 0; i < n; i++) to->size[i] = fro->size[order[i]];
+  for (i = 0; i < n; i++) to->md5[i] = fro->md5[order[i]];
+  memset(to->delete, 0, ((n + 63) / 64) * sizeof(uint64_t));
+  for (i = 0; i < n; i++) {
+    if (isdeleted(fro, order[i])) setdeleted(to, i);
+  }
+} // frlist_gather()
 
 static void
 delete_groups_of_files_sharing_size_and_inode(prgvar_t *pv)
@@ -531,67 +1078,738 @@ delete_groups_of_files_sharing_size_and_inode(prgvar_t *pv)
   * As this begins, the list sorted on size and inode, is already in
   * place in pv->list2 and is counted by pv->lc2.
   */
-  int count = 0;
   int i, j;
-  for (i = 1; i < pv->lc2; i++) {
-    if (pv->list2[i].size == pv->list2[i-1].size &&
-        pv->list2[i].inode == pv->list2[i-1].inode) {
-      count++;
-    } else {
-      if (count) {
-        for (j = i-count-1; j < i; j++) {
-          pv->list2[j].delete_flag = 1;
-        } // for (j...)
-      } // if(count)
-      count = 0;
-    } // else
+  for (i = 0; i < pv->lc2; i = j) {
+    for (j = i + 1; j < pv->lc2; j++) {
+      if (pv->list2.size[j] != pv->list2.size[i] ||
+          pv->list2.inode[j] != pv->list2.inode[i]) break;
+    }
+    if (j - i > 1) {
+      int k;
+      for (k = i; k < j; k++) setdeleted(&pv->list2, k);
+    }
   } // for(size and inode comparisons)
-  // count the number of items to send back to pv->list1.
-  for (j = 0, i = 0; j < pv->lc2; j++) {
-    if (pv->list2[j].delete_flag == 0) i++;
-  }
-  pv->lc1 = i;
-  /* write the non-deletes back to the originating array. */
-  for (i = 0, j  = 0; i < pv->lc2; i++) {
-    if (pv->list2[i].delete_flag == 0) {
-      pv->list1[j] = pv->list2[i];
+  /* Sort the non-deletes on inode and write them back to the
+   * originating list, which now holds the records in inode order. */
+  ikey_t *keys = xcalloc(pv->lc2, sizeof(struct ikey_t));
+  for (i = 0, j = 0; i < pv->lc2; i++) {
+    if (!isdeleted(&pv->list2, i)) {
+      keys[j].inode = pv->list2.inode[i];
+      keys[j].idx = i;
       j++;
     } // if()
   } // for(i...)
   pv->lc1 = j;
-  /* Now sort the list, pv->list1 in inode order. */
-  qsort(pv->list1, pv->lc1, sizeof(struct filerec_t), cmpinodep);
+  rsort(keys, pv->lc1, &ikey_sort, pv->threads);
+  uint32_t *order = xcalloc(pv->lc1 + 1, sizeof(uint32_t));
+  for (i = 0; i < pv->lc1; i++) order[i] = keys[i].idx;
+  free(keys);
+  frlist_gather(&pv->list1, &pv->list2, order, pv->lc1);
+  free(order);
 } // delete_groups_of_files_sharing_size_and_inode()
 
 static void
-calcmd5sums(filerec_t *list, int lc, int pages)
-{ /* Controls the md5sum calculation of a list of files. */
+compare_in_lockstep(prgvar_t *pv)
+{ /* A size group of a few files too big for the head and tail hashes to
+   * settle may be cheaper to compare side by side than to hash, see
+   * lockstep_chunk(). Those that match another file in their group
+   * take the digest lockstep() gives them and move to pv->settled,
+   * out of the way of the hash stages, and those that match none are
+   * dropped. list1 keeps the rest, in inode order.
+  */
+  sikey_t *keys = xcalloc(pv->lc1 + 1, sizeof(struct sikey_t));
+  int i, j, k;
+  for (i = 0; i < pv->lc1; i++) {
+    keys[i].size = pv->list1.size[i];
+    keys[i].inode = pv->list1.inode[i];
+    keys[i].idx = i;
+  }
+  rsort(keys, pv->lc1, &sikey_sort, pv->threads);
+  char *fate = xcalloc(pv->lc1 + 1, 1);  // 1 settled, 2 dropped.
+  size_t first = (pv->pages > 0) ? (size_t)pv->pages * 4096 : 4096;
+  int groups = 0;
+  for (i = 0; i < pv->lc1; i = j) {
+    for (j = i + 1; j < pv->lc1 && keys[j].size == keys[i].size; j++) ;
+    int n = j - i;
+    if (n < 2 || n > pv->lockstep) continue;
+    int rot = 0;
+    for (k = i; k < j; k++) {
+      rot |= pv->rotating[record_device(pv, pv->list1.path[keys[k].idx])];
+    }
+    size_t chunk = lockstep_chunk(pv, n, keys[i].size, rot);
+    if (!chunk) continue;
+    char names[LOCKSTEP_MAX][PATH_MAX];
+    const char *paths[LOCKSTEP_MAX];
+    int set[LOCKSTEP_MAX];
+    md5_t md5[LOCKSTEP_MAX];
+    for (k = 0; k < n; k++) {
+      paths[k] = ps_path(pv->ps, pv->list1.path[keys[i+k].idx], names[k]);
+    }
+    lockstep(paths, n, keys[i].size, first, chunk, set, md5);
+    for (k = 0; k < n; k++) {
+      uint32_t x = keys[i+k].idx;
+      fate[x] = (set[k] == -1) ? 2 : 1;
+      if (set[k] != -1) pv->list1.md5[x] = md5[k];
+    }
+    groups++;
+  } // for(i...)
+  free(keys);
+  if (groups) {
+    uint32_t *order = xcalloc(pv->lc1 + 1, sizeof(uint32_t));
+    for (i = 0, j = 0; i < pv->lc1; i++) {
+      if (fate[i] == 1) order[j++] = i;
+    }
+    pv->nsettled = j;
+    frlist_alloc(&pv->settled, pv->nsettled);
+    frlist_gather(&pv->settled, &pv->list1, order, pv->nsettled);
+    for (i = 0, j = 0; i < pv->lc1; i++) {
+      if (!fate[i]) order[j++] = i;
+    }
+    frlist_gather(&pv->list2, &pv->list1, order, j);
+    free(order);
+    pv->lc1 = j;
+    frlist_t tmp = pv->list1;
+    pv->list1 = pv->list2;
+    pv->list2 = tmp;
+    fprintf(stderr, "%d group%s of files compared side by side.\n",
+            groups, (groups == 1) ? "" : "s");
+  }
+  free(fate);
+} // compare_in_lockstep()
+
+static size_t
+lockstep_chunk(prgvar_t *pv, int n, size_t size, int rotating)
+{ /* The chunk lockstep() is to read n files of size bytes in, or 0 if
+   * they had better be hashed. Either way each file is read up to its
+   * first difference with the others, or whole if it has none; though
+   * hashing a file that reaches HASH_FULL reads its head and tail again.
+   * Hashing works each file through the digest, where lockstep() does
+   * one file for each set of identical files; but from a spinning disk
+   * it must seek from file to file between chunks, where hashing reads
+   * each straight through. Files the head and tail hashes read whole
+   * are left to them, and files for a tree or sparse digest to those.
+  */
+  size_t block = (size_t)pv->pages * 4096;
+  if (pv->pages > 0 && size <= 2 * block) return 0;
+  if (pv->tree_size && size >= pv->tree_size) return 0;
+  if (pv->sparse_size && size >= pv->sparse_size) return 0;
+  if (!rotating) return LOCK_CHUNK;
+  double seek = (double)n * ((size + LOCK_CHUNK_HDD - 1) / LOCK_CHUNK_HDD)
+                * LOCK_SEEK_MS;
+  double hash = (double)(n - 1) * size / (LOCK_HASH_MBS * 1000.0);
+  return (seek < hash) ? LOCK_CHUNK_HDD : 0;
+} // lockstep_chunk()
+
+static int
+restore_settled(prgvar_t *pv)
+{ /* Put the records of compare_in_lockstep() back at the front of list1
+   * for the last hash stage, which passes over them. Returns how many.
+  */
+  int n = pv->nsettled;
+  if (!n) return 0;
+  frlist_t *l = &pv->list1;
+  memmove(l->path + n, l->path, pv->lc1 * sizeof(uint32_t));
+  memmove(l->inode + n, l->inode, pv->lc1 * sizeof(ino_t));
+  memmove(l->size + n, l->size, pv->lc1 * sizeof(size_t));
+  memmove(l->md5 + n, l->md5, pv->lc1 * sizeof(md5_t));
+  memcpy(l->path, pv->settled.path, n * sizeof(uint32_t));
+  memcpy(l->inode, pv->settled.inode, n * sizeof(ino_t));
+  memcpy(l->size, pv->settled.size, n * sizeof(size_t));
+  memcpy(l->md5, pv->settled.md5, n * sizeof(md5_t));
+  pv->lc1 += n;
+  memset(l->delete, 0, ((pv->lc1 + 63) / 64) * sizeof(uint64_t));
+  frlist_free(&pv->settled);
+  pv->nsettled = 0;
+  return n;
+} // restore_settled()
+
+static void
+calcmd5sums(prgvar_t *pv, frlist_t *list, int lc, int stage, int start)
+{ /* Controls the md5sum calculation of a list of files, for one stage
+   * of stage_digest(). The list is in inode order, or disk order for
+   * --hdd, and is hashed by the device pools of hash_records(). A file
+   * that can not be read is marked for deletion. The records before
+   * start already have their digests, see restore_settled().
+  */
+  int i;
+  char *bad = xcalloc(lc + 1, 1);
+  hjob_t job = { pv, stage, start, lc, list->path, list->inode, list->size,
+                 list->md5, bad };
+  hash_records(&job);
+  for (i = 0; i < lc; i++) {
+    if (bad[i]) setdeleted(list, i);
+  }
+  free(bad);
+  /* Now sort the list on md5sum w/ inode as secondary key. The sorted
+   * records go to list2, which then changes places with list1. */
+  mkey_t *keys = xcalloc(lc, sizeof(struct mkey_t));
+  for (i = 0; i < lc; i++) {
+    keys[i].md5 = list->md5[i];
+    keys[i].inode = list->inode[i];
+    keys[i].idx = i;
+  }
+  rsort(keys, lc, &mkey_sort, pv->threads);
+  uint32_t *order = xcalloc(lc + 1, sizeof(uint32_t));
+  for (i = 0; i < lc; i++) order[i] = keys[i].idx;
+  free(keys);
+  frlist_t *other = (list == &pv->list1) ? &pv->list2 : &pv->list1;
+  frlist_gather(other, list, order, lc);
+  free(order);
+  frlist_t tmp = *list;
+  *list = *other;
+  *other = tmp;
+} // calcmd5sums()
+
+static int
+stage_digest(prgvar_t *pv, c5batch_t *batch, const char *path,
+             size_t size, int stage, md5_t *md5)
+{ /* Hashing is done in stages, each applied only to the files whose
+   * digest from the stage before is shared with another file:
+   * HASH_HEAD hashes the size and the first pv->pages of the file,
+   * HASH_TAIL hashes the head digest and the last pv->pages, with
+   * --sample HASH_SAMPLE hashes the tail digest and sample_count()
+   * blocks of pv->pages spread over the file, and HASH_FULL gives the
+   * md5sum of the whole file. A file no bigger than pv->pages, or any
+   * file if pages < 1, gets its md5sum at HASH_HEAD and keeps it. So
+   * most files are told apart by reading a few KB, and the digests
+   * written out are whole file md5sums unless digest_label() says not;
+   * with --sparse big files get the digest of calcmd5_sparse() instead.
+   * What is read goes into batch, which must be run before md5 is
+   * used, see calcmd5_batch_add(). Returns -1 if the file can not be
+   * read.
+  */
+  rhreq_t rq;
+  if (!stage_request(pv, size, stage, md5, &rq)) return 0;
+  if (sparse_stage(pv, size, stage)) {
+    return calcmd5_sparse(path, 0, size, md5);
+  }
+  if (stage == HASH_SAMPLE) {
+    return calcmd5_sample(path, rq.prefix, rq.plen, sample_count(pv, size),
+                          rq.pages, md5);
+  }
+  return calcmd5_batch_add(batch, path, rq.prefix, rq.plen, rq.from,
+                           rq.pages, md5);
+} // stage_digest()
+
+static int
+stage_request(prgvar_t *pv, size_t size, int stage, const md5_t *md5,
+              rhreq_t *rq)
+{ /* Fill in what stage_digest() is to hash of a file, all but the
+   * path. Returns 0 if the file keeps the digest it has.
+  */
+  size_t block = (size_t)pv->pages * 4096;
+  rq->plen = 0;
+  rq->from = 0;
+  rq->pages = 0;
+  if (tree_stage(pv, size, stage)) return 0;  // see hash_records().
+  if (pv->pages < 1 || size <= block) {
+    rq->pages = pv->pages;
+    return (stage == HASH_HEAD);
+  }
   int i;
-  strcpy(list[0].md5, calcmd5(list[0].path, pages));
-  for (i = 1; i < lc-1; i++) {
-    if (list[i].inode == list[i-1].inode) {
-      strcpy(list[i].md5, list[i-1].md5);
+  switch (stage) {
+  case HASH_HEAD:
+    for (i = 0; i < 8; i++) rq->prefix[i] = (uint64_t)size >> (8 * (7 - i));
+    rq->plen = 8;
+    rq->pages = pv->pages;
+    break;
+  case HASH_TAIL:
+    md5bytes(md5, rq->prefix);
+    rq->plen = 16;
+    rq->from = size - block;
+    rq->pages = pv->pages;
+    break;
+  case HASH_SAMPLE: // the blocks are placed by calcmd5_sample().
+    md5bytes(md5, rq->prefix);
+    rq->plen = 16;
+    rq->pages = pv->pages;
+    break;
+  } // switch(), HASH_FULL is the whole file.
+  return 1;
+} // stage_request()
+
+static void
+hash_records(hjob_t *job)
+{ /* Hash job->n records, from job->start. The files are shared out by
+   * the device they are on, and each device has its own pool of
+   * threads, pv->streams of them, so that disks are read side by side
+   * and none has more reads queued than suits it. The caller is one of
+   * the threads. A run of records with one inode is the same file,
+   * hashed once by the pool of its first record. Files for a tree
+   * digest are done first, one at a time, and are left out of the
+   * pools so that their digests, and whether they could be read, stand.
+  */
+  prgvar_t *pv = job->pv;
+  if (pv->tree_size) tree_records(job);
+  hpool_t pools[DEV_MAX];
+  memset(pools, 0, sizeof(pools));
+  int8_t *devof = xcalloc(job->n + 1, 1);
+  int i, d;
+  for (i = job->start; i < job->n; i++) {
+    if (i > job->start && job->inode[i] == job->inode[i-1]) continue;
+    if (tree_stage(pv, job->size[i], job->stage)) continue;
+    devof[i] = record_device(pv, job->path[i]);
+    pools[devof[i]].nruns++;
+  }
+  for (d = 0; d < pv->ndevs; d++) {
+    pools[d].job = job;
+    pools[d].runs = xcalloc(pools[d].nruns + 1, sizeof(uint32_t));
+    pools[d].nruns = 0;
+  }
+  for (i = job->start; i < job->n; i++) {
+    if (i > job->start && job->inode[i] == job->inode[i-1]) continue;
+    if (tree_stage(pv, job->size[i], job->stage)) continue;
+    hpool_t *pool = &pools[(int)devof[i]];
+    pool->runs[pool->nruns++] = i;
+  }
+  free(devof);
+  int nthreads = 0;
+  pthread_t *tids = xcalloc(pv->ndevs * (pv->hash_threads + 1),
+                            sizeof(pthread_t));
+  for (d = 0; d < pv->ndevs; d++) {
+    int want = pv->streams[d];
+    if (want > pools[d].nruns / HASH_CLAIM) {
+      want = pools[d].nruns / HASH_CLAIM;
+    }
+    if (want < 1) want = 1;
+    if (!pools[d].nruns) want = 0;
+    for (i = 0; i < want; i++) {
+      if (!nthreads) { // the first is the caller, started last.
+        nthreads++;
+        continue;
+      }
+      if (pthread_create(&tids[nthreads], NULL, hash_worker, &pools[d])) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+      }
+      nthreads++;
+    }
+  } // for(d...)
+  for (d = 0; d < pv->ndevs && !pools[d].nruns; d++) ;
+  if (d < pv->ndevs) hash_worker(&pools[d]);
+  for (i = 1; i < nthreads; i++) pthread_join(tids[i], NULL);
+  free(tids);
+  for (d = 0; d < pv->ndevs; d++) free(pools[d].runs);
+} // hash_records()
+
+static void
+*hash_worker(void *p)
+{ /* Claim the files of a pool HASH_CLAIM at a time, in list order.
+   * The digest of a file is copied along the run of records that share
+   * its inode. So each record is written by one thread only and no lock
+   * is needed. The kernel is asked to start reading each file while the
+   * one before it is hashed. The small files of a claim are hashed
+   * together once all are read, see calcmd5_batch_add().
+  */
+  hpool_t *pool = p;
+  hjob_t *job = pool->job;
+  if (job->pv->read_mode == READ_URING && job->stage != HASH_SAMPLE
+      && ring_worker(pool)) return NULL;  // sampling is done here.
+  char buf[PATH_MAX];
+  c5batch_t *batch = calcmd5_batch_init();
+  while (1) {
+    int k = __atomic_fetch_add(&pool->next, HASH_CLAIM, __ATOMIC_RELAXED);
+    if (k >= pool->nruns) break;
+    int end = (k + HASH_CLAIM < pool->nruns) ? k + HASH_CLAIM
+                                             : pool->nruns;
+    int first = k;
+    for ( ; k < end; k++) {
+      int i = pool->runs[k];
+      if (k + 1 < end) prefetch_record(job, pool->runs[k+1]);
+      ps_path(job->pv->ps, job->path[i], buf);
+      job->bad[i] = (stage_digest(job->pv, batch, buf, job->size[i],
+                                  job->stage, &job->md5[i]) == -1);
+    }
+    calcmd5_batch_run(batch);
+    for (k = first; k < end; k++) {
+      int i = pool->runs[k];
+      int j;
+      for (j = i + 1; j < job->n && job->inode[j] == job->inode[i]; j++) {
+        job->md5[j] = job->md5[i];
+        job->bad[j] = job->bad[i];
+      }
+    } // for(k...)
+  } // while()
+  calcmd5_batch_free(batch);
+  return NULL;
+} // hash_worker()
+
+static void
+prefetch_record(hjob_t *job, int i)
+{ /* calcmd5_prefetch() what stage_digest() will read of record i. */
+  rhreq_t rq;
+  if (!stage_request(job->pv, job->size[i], job->stage, &job->md5[i],
+                     &rq)) return;
+  ps_path(job->pv->ps, job->path[i], rq.path);
+  calcmd5_prefetch(rq.path, rq.from, rq.pages);
+} // prefetch_record()
+
+static int
+ring_worker(hpool_t *pool)
+{ /* hash_worker() for READ_URING, with RING_DEPTH files in hand at
+   * once. Returns 0 if io_uring is not to be had.
+  */
+  rwork_t w = { pool, 0, 0 };
+  return ringhash(RING_DEPTH, ring_next, ring_done, &w);
+} // ring_worker()
+
+static int
+ring_next(rhreq_t *rq, void *arg)
+{ /* ringhash() callback, the next file of the pool to be read. A file
+   * that keeps its digest at this stage is done with at once, and one
+   * for a sparse digest is hashed here, its holes needing lseek(2). */
+  rwork_t *w = arg;
+  hjob_t *job = w->pool->job;
+  while (1) {
+    if (w->k == w->end) {
+      w->k = __atomic_fetch_add(&w->pool->next, HASH_CLAIM,
+                                __ATOMIC_RELAXED);
+      if (w->k >= w->pool->nruns) {
+        w->end = w->k;
+        return 0;
+      }
+      w->end = (w->k + HASH_CLAIM < w->pool->nruns) ? w->k + HASH_CLAIM
+                                                    : w->pool->nruns;
+    }
+    int i = w->pool->runs[w->k++];
+    rq->tag = i;
+    if (stage_request(job->pv, job->size[i], job->stage, &job->md5[i],
+                      rq)) {
+      ps_path(job->pv->ps, job->path[i], rq->path);
+      if (!sparse_stage(job->pv, job->size[i], job->stage)) return 1;
+      rq->bad = (stage_digest(job->pv, NULL, rq->path, job->size[i],
+                              job->stage, &job->md5[i]) == -1);
     } else {
-      strcpy(list[i].md5, calcmd5(list[i].path, pages));
+      rq->bad = 0;
     }
-  } // for(i ...)
-  if (list[lc-1].inode == list[lc-2].inode) {
-    strcpy(list[lc-1].md5, list[lc-2].md5);
-  } else {
-    strcpy(list[lc-1].md5, calcmd5(list[lc-1].path, pages));
+    rq->md5 = job->md5[i];
+    ring_done(rq, arg);
+  } // while()
+} // ring_next()
+
+static void
+ring_done(const rhreq_t *rq, void *arg)
+{ /* ringhash() callback, keep the digest of a file for all its names. */
+  rwork_t *w = arg;
+  hjob_t *job = w->pool->job;
+  int i = rq->tag;
+  int j;
+  job->md5[i] = rq->md5;
+  job->bad[i] = rq->bad;
+  for (j = i + 1; j < job->n && job->inode[j] == job->inode[i]; j++) {
+    job->md5[j] = rq->md5;
+    job->bad[j] = rq->bad;
   }
-  /* Now sort the list on md5sum w/ inode as secondary key */
-  qsort(list, lc, sizeof(struct filerec_t), cmpmd5p);
-} // calcmd5sums()
+} // ring_done()
+
+static int
+whole_stage(prgvar_t *pv, size_t size, int stage)
+{ /* Returns 1 if this is the stage that hashes a file of size bytes
+   * whole. */
+  size_t block = (size_t)pv->pages * 4096;
+  if (pv->pages < 1 || size <= block) return stage == HASH_HEAD;
+  return stage == HASH_FULL;
+} // whole_stage()
+
+static int
+tree_stage(prgvar_t *pv, size_t size, int stage)
+{ /* Returns 1 if a file of size bytes is to get a tree digest at this
+   * stage. */
+  if (!pv->tree_size || size < pv->tree_size) return 0;
+  return whole_stage(pv, size, stage);
+} // tree_stage()
+
+static int
+sparse_stage(prgvar_t *pv, size_t size, int stage)
+{ /* Returns 1 if a file of size bytes is to get a sparse digest, see
+   * calcmd5_sparse(), at this stage; within a tree digest it is each
+   * segment that does. */
+  if (!pv->sparse_size || size < pv->sparse_size) return 0;
+  return whole_stage(pv, size, stage);
+} // sparse_stage()
+
+static void
+tree_records(hjob_t *job)
+{ /* Give each file of the job at least pv->tree_size bytes, at the stage
+   * that would hash it whole, its tree digest rather than its md5sum.
+   * Such a file would keep one thread busy for minutes, so its segments
+   * are shared out among the threads of its device instead; the hash
+   * stages then pass it over, see hash_records(). Every file of a size
+   * group gets the same kind of digest.
+  */
+  prgvar_t *pv = job->pv;
+  char buf[PATH_MAX];
+  int i, j;
+  for (i = job->start; i < job->n; i++) {
+    if (i > job->start && job->inode[i] == job->inode[i-1]) continue;
+    if (!tree_stage(pv, job->size[i], job->stage)) continue;
+    int d = record_device(pv, job->path[i]);
+    ps_path(pv->ps, job->path[i], buf);
+    int sparse = sparse_stage(pv, job->size[i], job->stage);
+    job->bad[i] = (tree_digest(buf, job->size[i], pv->streams[d], sparse,
+                               &job->md5[i]) == -1);
+    for (j = i + 1; j < job->n && job->inode[j] == job->inode[i]; j++) {
+      job->md5[j] = job->md5[i];
+      job->bad[j] = job->bad[i];
+    }
+  } // for(i...)
+} // tree_records()
+
+static int
+tree_digest(const char *path, size_t size, int threads, int sparse,
+            md5_t *md5)
+{ /* The tree digest of the file at path: the digest of its size, as 8
+   * bytes most significant first, followed by the digest of each
+   * TREE_SEG segment of it in turn, a sparse digest if sparse is set.
+   * The segments are hashed by up to threads threads, the caller being
+   * one. Returns -1 if the file can not be read.
+  */
+  tjob_t t = { path, (size + TREE_SEG - 1) / TREE_SEG, 0, NULL, 0,
+               sparse };
+  t.seg = xcalloc(t.nseg + 1, sizeof(md5_t));
+  if (threads > t.nseg) threads = t.nseg;
+  if (threads < 1) threads = 1;
+  pthread_t *tids = xcalloc(threads, sizeof(pthread_t));
+  int i;
+  for (i = 1; i < threads; i++) {
+    if (pthread_create(&tids[i], NULL, tree_worker, &t)) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  tree_worker(&t);
+  for (i = 1; i < threads; i++) pthread_join(tids[i], NULL);
+  free(tids);
+  if (!t.bad) {
+    hash_t h;
+    unsigned char bytes[HASH_LEN];
+    hash_start(&h);
+    for (i = 0; i < 8; i++) bytes[i] = (uint64_t)size >> (8 * (7 - i));
+    hash_update(&h, bytes, 8);
+    for (i = 0; i < t.nseg; i++) {
+      md5bytes(&t.seg[i], bytes);
+      hash_update(&h, bytes, HASH_LEN);
+    }
+    hash_final(&h, bytes);
+    md5set(md5, bytes);
+  }
+  free(t.seg);
+  return (t.bad) ? -1 : 0;
+} // tree_digest()
+
+static void
+*tree_worker(void *p)
+{ /* Claim the segments of a file one at a time and hash them. */
+  tjob_t *t = p;
+  while (1) {
+    int k = __atomic_fetch_add(&t->next, 1, __ATOMIC_RELAXED);
+    if (k >= t->nseg) break;
+    int res = (t->sparse)
+              ? calcmd5_sparse(t->path, (off_t)k * TREE_SEG, TREE_SEG,
+                               &t->seg[k])
+              : calcmd5_block(t->path, NULL, 0, (off_t)k * TREE_SEG,
+                              TREE_SEG / 4096, &t->seg[k]);
+    if (res == -1) {
+      __atomic_store_n(&t->bad, 1, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+} // tree_worker()
+
+static int
+record_device(prgvar_t *pv, uint32_t path)
+{ /* Returns the index in pv->devs of the device holding the file. It
+   * is the device of the file's dir, which is stat()ed the first time
+   * it is met. A device gets a single hashing thread if it is a
+   * spinning disk, else pv->hash_threads. Devices past DEV_MAX share
+   * the last pool.
+  */
+  uint32_t dir = pv->ps->files[path].dir;
+  if (dir >= pv->dirdev_cap) {
+    uint32_t cap = (pv->dirdev_cap) ? pv->dirdev_cap : 1024;
+    while (cap <= dir) cap *= 2;
+    pv->dirdev = realloc(pv->dirdev, cap);
+    if (!pv->dirdev) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+    memset(pv->dirdev + pv->dirdev_cap, -1, cap - pv->dirdev_cap);
+    pv->dirdev_cap = cap;
+  }
+  if (pv->dirdev[dir] != -1) return pv->dirdev[dir];
+  char buf[PATH_MAX];
+  ps_path(pv->ps, path, buf);
+  char *cp = strrchr(buf, '/');
+  if (cp == buf) cp++;  // a file in /
+  if (cp) *cp = 0;
+  struct stat sb;
+  if (stat(buf, &sb) == -1) sb.st_dev = 0;
+  int d;
+  for (d = 0; d < pv->ndevs && pv->devs[d] != sb.st_dev; d++) ;
+  if (d == pv->ndevs && d < DEV_MAX) {
+    int rot = blkdev_rotational(sb.st_dev);
+    pv->devs[d] = sb.st_dev;
+    pv->rotating[d] = (rot == 1);
+    pv->streams[d] = (rot == 1) ? 1 : pv->hash_threads;
+    pv->ndevs++;
+    fprintf(stderr, "Device %u:%u, %s, %d hashing thread%s.\n",
+            major(sb.st_dev), minor(sb.st_dev),
+            (rot == 1) ? "rotational" : (rot == 0) ? "solid state"
+                                                   : "not a disk",
+            pv->streams[d], (pv->streams[d] == 1) ? "" : "s");
+  }
+  if (d == DEV_MAX) d = DEV_MAX - 1;
+  pv->dirdev[dir] = d;
+  return d;
+} // record_device()
+
+static int
+last_stage(prgvar_t *pv, int stage)
+{ /* with pages < 1 the head stage hashed every file whole. */
+  return stage == HASH_FULL || pv->pages < 1
+         || (stage == HASH_SAMPLE && pv->sample == SAMPLE_ONLY);
+} // last_stage()
+
+static int
+next_stage(prgvar_t *pv, int stage)
+{ /* the stage after this one, HASH_SAMPLE only with --sample. */
+  stage++;
+  if (stage == HASH_SAMPLE && pv->sample == SAMPLE_OFF) stage++;
+  return stage;
+} // next_stage()
+
+static int
+sample_count(prgvar_t *pv, size_t size)
+{ /* The blocks HASH_SAMPLE reads of a file: 2, and SAMPLE_STEP more
+   * each time the file doubles in size past 2 blocks, up to SAMPLE_MAX
+   * or the blocks there are. So the reading for each file is bounded
+   * however big it is.
+  */
+  size_t blocks = size / ((size_t)pv->pages * 4096);
+  size_t b;
+  int n = 2;
+  for (b = blocks; b > 2 && n < SAMPLE_MAX; b /= 2) n += SAMPLE_STEP;
+  if (n > SAMPLE_MAX) n = SAMPLE_MAX;
+  if ((size_t)n > blocks) n = (blocks) ? blocks : 1;
+  return n;
+} // sample_count()
+
+static const char
+*digest_label(prgvar_t *pv, size_t size)
+{ /* What goes ahead of hash_label() for a file of size bytes whose
+   * digest is not its md5sum: "sample:" where --sample=only stopped
+   * short of HASH_FULL, "tree:" for tree_digest() and "sparse:" for
+   * calcmd5_sparse(), or both. */
+  size_t block = (size_t)pv->pages * 4096;
+  if (pv->sample == SAMPLE_ONLY && pv->pages > 0 && size > block) {
+    return "sample:";
+  }
+  int tree = (pv->tree_size && size >= pv->tree_size);
+  int sparse = (pv->sparse_size && size >= pv->sparse_size);
+  if (tree) return (sparse) ? "tree:sparse:" : "tree:";
+  return (sparse) ? "sparse:" : "";
+} // digest_label()
+
+static void
+sort_by_inode(prgvar_t *pv)
+{ /* The survivors of a hash stage, in list2, go back to list1 in inode
+   * order for the next stage. */
+  ikey_t *keys = xcalloc(pv->lc2, sizeof(struct ikey_t));
+  int i;
+  for (i = 0; i < pv->lc2; i++) {
+    keys[i].inode = pv->list2.inode[i];
+    keys[i].idx = i;
+  }
+  rsort(keys, pv->lc2, &ikey_sort, pv->threads);
+  uint32_t *order = xcalloc(pv->lc2 + 1, sizeof(uint32_t));
+  for (i = 0; i < pv->lc2; i++) order[i] = keys[i].idx;
+  free(keys);
+  pv->lc1 = pv->lc2;
+  frlist_gather(&pv->list1, &pv->list2, order, pv->lc1);
+  free(order);
+} // sort_by_inode()
+
+static void
+extent_order(prgvar_t *pv, const uint32_t *path, const ino_t *inode,
+             int n, uint32_t *order)
+{ /* Put into order the indexes of n records, sorted by the address on
+   * disk of the start of their data, then by inode. The records are in
+   * inode order already, so the FIEMAP lookups go through the inode
+   * tables in order. A file whose address can not be had, as on a
+   * filesystem without FIEMAP, is given 0, so those files come first,
+   * in inode order as before.
+  */
+  pkey_t *keys = xcalloc(n + 1, sizeof(struct pkey_t));
+  char buf[PATH_MAX];
+  int i;
+  for (i = 0; i < n; i++) {
+    if (i > 0 && inode[i] == inode[i-1]) {
+      keys[i].physical = keys[i-1].physical;  // the same file.
+    } else {
+      ps_path(pv->ps, path[i], buf);
+      if (extent_first(buf, &keys[i].physical) == -1) keys[i].physical = 0;
+    }
+    keys[i].inode = inode[i];
+    keys[i].idx = i;
+  }
+  rsort(keys, n, &pkey_sort, pv->threads);
+  for (i = 0; i < n; i++) order[i] = keys[i].idx;
+  free(keys);
+} // extent_order()
+
+static void
+sort_by_extent(prgvar_t *pv)
+{ /* --hdd, list1 goes into the order of its data on disk for hashing.
+   * The names of one file stay together, as hash_records() needs. */
+  uint32_t *order = xcalloc(pv->lc1 + 1, sizeof(uint32_t));
+  extent_order(pv, pv->list1.path, pv->list1.inode, pv->lc1, order);
+  frlist_gather(&pv->list2, &pv->list1, order, pv->lc1);
+  free(order);
+  frlist_t tmp = pv->list1;
+  pv->list1 = pv->list2;
+  pv->list2 = tmp;
+} // sort_by_extent()
+
+static void
+permute(void *base, size_t width, const uint32_t *order, int n,
+        void *tmp)
+{ /* base[i] = base[order[i]] for the n elements of width bytes at
+   * base, by way of tmp which must hold them all. */
+  char *from = base;
+  char *to = tmp;
+  int i;
+  for (i = 0; i < n; i++) {
+    memcpy(to + i * width, from + order[i] * width, width);
+  }
+  memcpy(base, tmp, n * width);
+} // permute()
+
+static int
+cmpphysp(const void *p1, const void *p2)
+{ /* disk address, then inode. */
+  pkey_t *frp1 = (pkey_t *)p1;
+  pkey_t *frp2 = (pkey_t *)p2;
+  if (frp1->physical > frp2->physical) {
+    return 1;
+  } else if (frp1->physical < frp2->physical) {
+    return -1;
+  } else if (frp1->inode > frp2->inode) {
+    return 1;
+  } else if (frp1->inode < frp2->inode) {
+    return -1;
+  }
+  return 0;
+} // cmpphysp()
 
 static int
 cmpmd5p(const void *p1, const void *p2)
-{ /* md5 sums are just C strings.
+{ /* md5 sums are two 64 bit words, most significant byte first, so
+   * they order as their hex strings would.
    * Use inode size as secondary key.
   */
-  filerec_t *frp1 = (filerec_t *)p1;
-  filerec_t *frp2 = (filerec_t *)p2;
-  int ret = strcmp(frp1->md5, frp2->md5);
+  mkey_t *frp1 = (mkey_t *)p1;
+  mkey_t *frp2 = (mkey_t *)p2;
+  int ret = md5cmp(&frp1->md5, &frp2->md5);
   if (ret > 0) {
     return 1;
   } else if (ret < 0) {
@@ -609,30 +1827,22 @@ delete_unique_md5sum_records(prgvar_t *pv)
 { /* mark unique md5sums for deletion. In this instance the source of
    * the 'from' data is in list1, the 'to' data is go to list2.
   */
-  if (strcmp(pv->list1[0].md5, pv->list1[1].md5) != 0)
-      pv->list1[0].delete_flag = 1; // the 0th record.
   int i;
-  for (i = 1; i < pv->lc1-1; i++) { // all recs between 0th and last.
-    if (strcmp(pv->list1[i].md5, pv->list1[i-1].md5) != 0 &&
-        strcmp(pv->list1[i].md5, pv->list1[i+1].md5) != 0) {
-      pv->list1[i].delete_flag = 1;
-    }
-  }
-  if (strcmp(pv->list1[pv->lc1-1].md5, pv->list1[pv->lc1-2].md5) != 0)
-    pv->list1[pv->lc1-1].delete_flag = 1; // the last record.
-  pv->lc2 = 0;
   for (i = 0; i < pv->lc1; i++) {
-    if (pv->list1[i].delete_flag == 0) pv->lc2++;
+    if ((i > 0 && md5cmp(&pv->list1.md5[i], &pv->list1.md5[i-1]) == 0) ||
+        (i < pv->lc1-1 &&
+         md5cmp(&pv->list1.md5[i], &pv->list1.md5[i+1]) == 0)) continue;
+    setdeleted(&pv->list1, i);
   }
   /* Copy records to list2, deleteable records excepted. */
+  uint32_t *order = xcalloc(pv->lc1 + 1, sizeof(uint32_t));
   int j = 0;
   for (i = 0; i < pv->lc1; i++) {
-    if (pv->list1[i].delete_flag == 0) {
-      pv->list2[j] = pv->list1[i];
-      j++; 
-    }
+    if (!isdeleted(&pv->list1, i)) order[j++] = i;
   }
-  pv->lc2 = j;  // redundant check.
+  pv->lc2 = j;
+  frlist_gather(&pv->list2, &pv->list1, order, pv->lc2);
+  free(order);
 } // delete_unique_md5sum_records()
 
 void
@@ -644,12 +1854,216 @@ serialise_duplicate_records(prgvar_t *pv)
   FILE *fpo = fopen("duplicates.lst", "w");
   int i;
   for (i = 0; i < pv->lc2; i++) {
-    fprintf(fpo, "%s\t%lu\t%lu\t%s\n", pv->list2[i].md5,
-            pv->list2[i].inode, pv->list2[i].size, pv->list2[i].path);
+    put_record(fpo, pv, &pv->list2.md5[i], pv->list2.inode[i],
+               pv->list2.size[i], pv->list2.path[i]);
   }
   fclose(fpo);
 } // serialise_duplicate_records()
 
+static void
+put_record(FILE *fpo, prgvar_t *pv, const md5_t *md5, ino_t inode,
+           size_t size, uint32_t path)
+{ /* write one line of duplicates.lst. A digest not made by MD5 is
+   * labelled with its algorithm, see hash_label(), and one that is not
+   * of the whole file with how it was made, see digest_label(). */
+  char buf[PATH_MAX];
+  char hex[33];
+  fprintf(fpo, "%s%s%s\t%lu\t%lu\t%s\n", digest_label(pv, size),
+          hash_label(), md5hex(md5, hex), inode, size,
+          ps_path(pv->ps, path, buf));
+} // put_record()
+
+static size_t
+parse_bytes(const char *s)
+{ /* a number of bytes, with an optional K, M or G suffix. */
+  char *end;
+  unsigned long long n = strtoull(s, &end, 10);
+  switch (toupper(*end)) {
+  case 'G':
+    n *= 1024;
+    /* FALLTHRU */
+  case 'M':
+    n *= 1024;
+    /* FALLTHRU */
+  case 'K':
+    n *= 1024;
+    end++;
+    break;
+  }
+  if (end == s || *end || n == 0) {
+    fprintf(stderr, "Not a size in bytes: %s\n", s);
+    exit(EXIT_FAILURE);
+  }
+  return n;
+} // parse_bytes()
+
+static void
+start_spill(prgvar_t *pv)
+{ /* The file records will not fit the --max-memory budget. Make a
+   * directory for the runs and hand it the records kept so far; from
+   * now on they go straight to the sorter, by size and inode. The
+   * budget is split between the sorter being read and the one being
+   * filled at each of the later passes.
+  */
+  const char *tmp = getenv("TMPDIR");
+  snprintf(pv->spilldir, PATH_MAX, "%s/filedupsXXXXXX", (tmp) ? tmp : "/tmp");
+  if (!mkdtemp(pv->spilldir)) {
+    perror(pv->spilldir);
+    exit(EXIT_FAILURE);
+  }
+  pv->spill = xs_init(pv->spilldir, "size", &sikey_sort,
+                      pv->max_memory / 2, pv->threads);
+  int i;
+  for (i = 0; pv->stats && i < pv->lc1; i++) {
+    sikey_t k = { pv->stats[i].size, pv->stats[i].inode, pv->stats[i].path };
+    xs_add(pv->spill, &k);
+  }
+  free(pv->stats);
+  pv->stats = NULL;
+  pv->stats_cap = 0;
+} // start_spill()
+
+static void
+external_duplicates(prgvar_t *pv)
+{ /* The passes from delete_unique_size_file_records() on, for records
+   * spilled to disk. Each pass reads one sorter in order and feeds the
+   * next, deciding on each record from its neighbours as the in memory
+   * passes do: first by size and inode, then by inode for the md5sums,
+   * then, for each hash stage, by inode for the hashing and by md5sum
+   * and inode to find what still collides. The last stage writes
+   * duplicates.lst.
+  */
+  extsort_t *byinode = xs_init(pv->spilldir, "inode", &irec_sort,
+                               pv->max_memory / 2, pv->threads);
+  xs_rewind(pv->spill);
+  xs_report(pv->spill, "Size and inode sort");
+  sikey_t s[3]; // previous, current and next.
+  int have[3] = { 0, xs_next(pv->spill, &s[1]), 0 };
+  if (have[1]) have[2] = xs_next(pv->spill, &s[2]);
+  while (have[1]) {
+    int same_prev = have[0] && s[0].size == s[1].size;
+    int same_next = have[2] && s[2].size == s[1].size;
+    int linked = (same_prev && s[0].inode == s[1].inode) ||
+                 (same_next && s[2].inode == s[1].inode);
+    if (s[1].size && (same_prev || same_next) && !linked) {
+      irec_t r = { { s[1].inode, s[1].idx }, s[1].size, { { 0, 0 } } };
+      xs_add(byinode, &r);
+    }
+    s[0] = s[1];
+    s[1] = s[2];
+    have[0] = 1;
+    have[1] = have[2];
+    if (have[1]) have[2] = xs_next(pv->spill, &s[2]);
+  } // while()
+  xs_free(pv->spill);
+  pv->spill = NULL;
+
+  FILE *fpo = fopen("duplicates.lst", "w");
+  /* Records are hashed HASH_BATCH at a time by hash_records(). A run
+   * of one inode that spans two batches takes its digest from the
+   * end of the first. With --hdd the rest of a batch is put in disk
+   * order before hashing. */
+  uint32_t *bpath = xcalloc(HASH_BATCH, sizeof(uint32_t));
+  ino_t *binode = xcalloc(HASH_BATCH, sizeof(ino_t));
+  size_t *bsize = xcalloc(HASH_BATCH, sizeof(size_t));
+  md5_t *bmd5 = xcalloc(HASH_BATCH, sizeof(md5_t));
+  char *bbad = xcalloc(HASH_BATCH, 1);
+  uint32_t *border = (pv->hdd) ? xcalloc(HASH_BATCH, sizeof(uint32_t))
+                               : NULL;
+  md5_t *btmp = (pv->hdd) ? xcalloc(HASH_BATCH, sizeof(md5_t)) : NULL;
+  int stage;
+  for (stage = HASH_HEAD; byinode; stage = next_stage(pv, stage)) {
+    extsort_t *bymd5 = xs_init(pv->spilldir, "md5", &drec_sort,
+                               pv->max_memory / 2, pv->threads);
+    xs_rewind(byinode);
+    xs_report(byinode, "Inode sort");
+    irec_t r;
+    int nb = 0, more = 1, carried = 0;
+    ino_t carry_inode = 0;           // the last inode of the batch before,
+    md5_t carry_md5 = { { 0, 0 } };  // its digest
+    char carry_bad = 0;              // and whether it could be read.
+    while (more) {
+      more = xs_next(byinode, &r);
+      if (more) {
+        bpath[nb] = r.key.idx;
+        binode[nb] = r.key.inode;
+        bsize[nb] = r.size;
+        bmd5[nb] = r.md5;
+        nb++;
+      }
+      if (nb < HASH_BATCH && (more || !nb)) continue;
+      int k, start = 0;
+      while (carried && start < nb && binode[start] == carry_inode) {
+        bmd5[start] = carry_md5;
+        bbad[start] = carry_bad;
+        start++;
+      }
+      ino_t tail = binode[nb-1]; // the last inode in the stream so far.
+      if (pv->hdd) {
+        int n = nb - start;
+        extent_order(pv, bpath + start, binode + start, n, border);
+        permute(bpath + start, sizeof(uint32_t), border, n, btmp);
+        permute(binode + start, sizeof(ino_t), border, n, btmp);
+        permute(bsize + start, sizeof(size_t), border, n, btmp);
+        permute(bmd5 + start, sizeof(md5_t), border, n, btmp);
+      }
+      hjob_t job = { pv, stage, start, nb, bpath, binode, bsize, bmd5,
+                     bbad };
+      hash_records(&job);
+      for (k = 0; k < nb; k++) {
+        if (bbad[k]) continue;
+        drec_t d = { { bmd5[k], binode[k], bpath[k] }, bsize[k] };
+        xs_add(bymd5, &d);
+      }
+      // keep the tail inode's digest for the next batch to see.
+      for (k = nb - 1; binode[k] != tail; k--) ;
+      carry_inode = binode[k];
+      carry_md5 = bmd5[k];
+      carry_bad = bbad[k];
+      carried = 1;
+      nb = 0;
+    } // while()
+    xs_free(byinode);
+    byinode = (last_stage(pv, stage)) ? NULL
+              : xs_init(pv->spilldir, "inode", &irec_sort,
+                        pv->max_memory / 2, pv->threads);
+
+    xs_rewind(bymd5);
+    xs_report(bymd5, "Md5sum sort");
+    drec_t m[3];
+    int mhave[3] = { 0, xs_next(bymd5, &m[1]), 0 };
+    if (mhave[1]) mhave[2] = xs_next(bymd5, &m[2]);
+    while (mhave[1]) {
+      if ((mhave[0] && md5cmp(&m[0].key.md5, &m[1].key.md5) == 0) ||
+          (mhave[2] && md5cmp(&m[2].key.md5, &m[1].key.md5) == 0)) {
+        if (byinode) {
+          irec_t next = { { m[1].key.inode, m[1].key.idx }, m[1].size,
+                          m[1].key.md5 };
+          xs_add(byinode, &next);
+        } else {
+          put_record(fpo, pv, &m[1].key.md5, m[1].key.inode, m[1].size,
+                     m[1].key.idx);
+        }
+      }
+      m[0] = m[1];
+      m[1] = m[2];
+      mhave[0] = 1;
+      mhave[1] = mhave[2];
+      if (mhave[1]) mhave[2] = xs_next(bymd5, &m[2]);
+    } // while()
+    xs_free(bymd5);
+  } // for(stage...)
+  fclose(fpo);
+  free(bpath);
+  free(binode);
+  free(bsize);
+  free(bmd5);
+  free(bbad);
+  free(border);
+  free(btmp);
+  rmdir(pv->spilldir);
+} // external_duplicates()
+
 char
 *prepare_excludes(const char *progname)
 { /* read the excludes file, strip out the comments, write the result
@@ -24,7 +24,7 @@
 
 options_t process_options(int argc, char **argv)
 {
-  optstring = ":hvp:d:i:";  // initialise
+  optstring = ":hvp:t:s:";  // initialise
 
   options_t opts = {0}; // will clang bitch?
   // add any non-zero, non-NULL default values.
@@ -37,9 +37,28 @@ options_t process_options(int argc, char **argv)
     static struct option long_options[] = {
     {"help",  0,  0,  'h' },
     {"version",  0,  0,  'v' },
-    {"pages",  0,  0,  'p' },
-    {"data-size",  0,  0,  'd' },
-    {"data-increment",  0,  0,  'i' },
+    {"pages",  1,  0,  'p' },
+    {"threads",  1,  0,  't' },
+    {"stat-mode",  1,  0,  's' },
+    {"dont-sync",  0,  0,  0 },
+    {"huge-pages",  0,  0,  0 },
+    {"low-memory",  0,  0,  0 },
+    {"max-memory",  1,  0,  0 },
+    {"hash",  1,  0,  0 },
+    {"hash-threads",  1,  0,  0 },
+    {"hdd",  0,  0,  0 },
+    {"read-mode",  1,  0,  0 },
+    {"block-size",  1,  0,  0 },
+    {"cache-neutral",  2,  0,  0 },
+    {"ioprio",  1,  0,  0 },
+    {"nice",  1,  0,  0 },
+    {"max-read",  1,  0,  0 },
+    {"max-stat",  1,  0,  0 },
+    {"kernel-hash",  0,  0,  0 },
+    {"lockstep",  1,  0,  0 },
+    {"tree-hash",  1,  0,  0 },
+    {"sample",  2,  0,  0 },
+    {"sparse",  1,  0,  0 },
     {0,  0,  0,  0 }
     };
 
@@ -52,6 +71,119 @@ options_t process_options(int argc, char **argv)
     switch (c) {
     case 0:
       switch (option_index) {
+      case 5: // dont-sync
+        opts.dont_sync = 1;
+      break;
+      case 6: // huge-pages
+        opts.hugepages = 1;
+      break;
+      case 7: // low-memory
+        opts.low_memory = 1;
+      break;
+      case 8: // max-memory
+        if (strlen(optarg) < 32) {
+          strcpy(opts.max_memory, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 9: // hash
+        if (strlen(optarg) < 32) {
+          strcpy(opts.hash, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 10: // hash-threads
+        opts.hash_threads = strtol(optarg, NULL, 10);
+      break;
+      case 11: // hdd
+        opts.hdd = 1;
+      break;
+      case 12: // read-mode
+        if (strlen(optarg) < 32) {
+          strcpy(opts.read_mode, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 13: // block-size
+        if (strlen(optarg) < 32) {
+          strcpy(opts.block_size, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 14: // cache-neutral[=direct]
+        if (!optarg) {
+          opts.cache_neutral = 1;
+        } else if (strcmp(optarg, "direct") == 0) {
+          opts.cache_neutral = 2;
+        } else {
+          fprintf(stderr, "Unknown argument to cache-neutral: %s\n",
+                  optarg);
+          exit(1);
+        }
+      break;
+      case 15: // ioprio
+        if (strlen(optarg) < 32) {
+          strcpy(opts.ioprio, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 16: // nice
+        opts.nice = strtol(optarg, NULL, 10);
+      break;
+      case 17: // max-read
+        if (strlen(optarg) < 32) {
+          strcpy(opts.max_read, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 18: // max-stat
+        opts.max_stat = strtol(optarg, NULL, 10);
+      break;
+      case 19: // kernel-hash
+        opts.kernel_hash = 1;
+      break;
+      case 20: // lockstep
+        opts.lockstep = strtol(optarg, NULL, 10);
+        opts.lockstep_given = 1;
+      break;
+      case 21: // tree-hash
+        if (strlen(optarg) < 32) {
+          strcpy(opts.tree_hash, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 22: // sample[=only]
+        if (!optarg) {
+          opts.sample = 1;
+        } else if (strcmp(optarg, "only") == 0) {
+          opts.sample = 2;
+        } else {
+          fprintf(stderr, "Unknown argument to sample: %s\n", optarg);
+          exit(1);
+        }
+      break;
+      case 23: // sparse
+        if (strlen(optarg) < 32) {
+          strcpy(opts.sparse, optarg);
+        } else {
+          fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
+          exit(1);
+        }
+      break;
     } // switch(option_index)
     break;
     case 'h':
@@ -62,18 +194,14 @@ options_t process_options(int argc, char **argv)
     break;
     case 'p':
       opts.pages =  strtol(optarg, NULL, 10);
+      opts.pages_given = 1;
     break;
-    case 'd':
-      if (strlen(optarg) < 32) {
-        strcpy(opts.dat_size, optarg);
-      } else {
-        fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
-        exit(1);
-      }
+    case 't':
+      opts.threads =  strtol(optarg, NULL, 10);
     break;
-    case 'i':
+    case 's':
       if (strlen(optarg) < 32) {
-        strcpy(opts.dat_incr, optarg);
+        strcpy(opts.stat_mode, optarg);
       } else {
         fprintf(stderr, "Argument to big for buffer: %s\n", optarg);
         exit(1);
@@ -27,8 +27,29 @@ typedef struct options_t {
   int     runhelp; // flag, dohelp(0)
   int     runvsn;  // flag, dovsn()
   int     pages;   // num
-  char    dat_size[32]; // data block size.
-  char    dat_incr[32]; // size to increase data space by.
+  int     pages_given; // flag, pages was set.
+  int     threads; // num, directory traversal threads.
+  char    stat_mode[32]; // how to stat files, 'walk', 'path' or 'uring'.
+  int     dont_sync; // flag, statx() may use cached attributes.
+  int     hugepages; // flag, path store may use huge pages.
+  int     low_memory; // flag, read the tree twice, sizes first.
+  char    max_memory[32]; // budget for file records, eg '512M'.
+  char    hash[32]; // digest algorithm, 'md5', 'xxh128' or 'blake3'.
+  int     hash_threads; // num, file hashing threads.
+  int     hdd; // flag, hash files in the order of their data on disk.
+  char    read_mode[32]; // how to read files to hash, 'sync' or 'uring'.
+  char    block_size[32]; // size of the reads made to hash, eg '1M'.
+  int     cache_neutral; // 0, 1, or 2 for with O_DIRECT.
+  char    ioprio[32]; // io priority, 'idle' or 'be[:N]'.
+  int     nice; // num, cpu priority decrement.
+  char    max_read[32]; // bytes a second to read, eg '20M'.
+  int     max_stat; // num, stats a second.
+  int     kernel_hash; // flag, md5 by AF_ALG.
+  int     lockstep; // num, most files of a size to compare side by side.
+  int     lockstep_given; // flag, lockstep was set.
+  char    tree_hash[32]; // files from this size get a tree digest, eg '1G'.
+  int     sample; // 0, 1, or 2 for in place of the full hash.
+  char    sparse[32]; // files from this size get a sparse digest, eg '1G'.
 } options_t;
 
 
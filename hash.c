@@ -0,0 +1,202 @@
+/*    hash.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of hash.[h|c] is to give one interface to the digest
+ * algorithms. See hash.h.
+ * */
+
+#include "hash.h"
+#include "xxh3.h"
+#include "md5mb.h"
+
+static const char *names[ALGO_COUNT] = { "md5", "xxh128", "blake3" };
+static int algo = ALGO_MD5;
+static const xxh3_ops_t *xxh3 = &xxh3_base;
+static const md5mb_ops_t *md5mb = &md5mb_base;
+
+int
+hash_byname(const char *name)
+{ /* the algorithm called name, or -1. */
+  int i;
+  for (i = 0; i < ALGO_COUNT; i++) {
+    if (strcmp(name, names[i]) == 0) return i;
+  }
+  return -1;
+} // hash_byname()
+
+void
+hash_select(int a)
+{ /* Use algorithm a from now on. For XXH3, and for MD5 of many
+   * messages at once, take the widest vector code the cpu, and the
+   * kernel, will run.
+  */
+  algo = a;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    xxh3 = &xxh3_avx512;
+    md5mb = &md5mb_avx512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    xxh3 = &xxh3_avx2;
+    md5mb = &md5mb_avx2;
+  }
+#endif
+} // hash_select()
+
+int
+hash_selected(void)
+{ /* the algorithm in use. */
+  return algo;
+} // hash_selected()
+
+const char
+*hash_label(void)
+{ /* What goes in front of a digest in duplicates.lst; MD5 digests go
+   * bare, as they always have. */
+  static char label[16];
+  if (algo == ALGO_MD5) return "";
+  sprintf(label, "%s:", names[algo]);
+  return label;
+} // hash_label()
+
+const char
+*hash_describe(void)
+{ /* the algorithm, and for XXH3 its code path, for messages. */
+  static char what[32];
+  if (algo == ALGO_XXH128) {
+    sprintf(what, "%s (%s)", names[algo], xxh3->isa);
+  } else if (algo == ALGO_MD5) {
+    sprintf(what, "%s (%s, %d lanes)", names[algo], md5mb->isa,
+            md5mb->lanes);
+  } else {
+    strcpy(what, names[algo]);
+  }
+  return what;
+} // hash_describe()
+
+void
+hash_start(hash_t *h)
+{ /* begin a digest with the selected algorithm. */
+  h->algo = algo;
+  switch (algo) {
+  case ALGO_MD5:
+    h->u.md5 = mhash_init(MHASH_MD5);
+    if (h->u.md5 == MHASH_FAILED) {
+      perror("Hash init failed");
+      exit(EXIT_FAILURE);
+    }
+    break;
+  case ALGO_XXH128:
+    h->u.xxh = xxh3->create();
+    if (!h->u.xxh) {
+      perror("XXH3_createState");
+      exit(EXIT_FAILURE);
+    }
+    xxh3->reset(h->u.xxh);
+    break;
+  case ALGO_BLAKE3:
+    blake3_init(&h->u.b3);
+    break;
+  } // switch()
+} // hash_start()
+
+void
+hash_update(hash_t *h, const void *p, size_t n)
+{ /* add n bytes. */
+  switch (h->algo) {
+  case ALGO_MD5:
+    mhash(h->u.md5, p, n);
+    break;
+  case ALGO_XXH128:
+    xxh3->update(h->u.xxh, p, n);
+    break;
+  case ALGO_BLAKE3:
+    blake3_update(&h->u.b3, p, n);
+    break;
+  } // switch()
+} // hash_update()
+
+void
+hash_final(hash_t *h, unsigned char *digest)
+{ /* HASH_LEN bytes of digest, and the state is done with. */
+  switch (h->algo) {
+  case ALGO_MD5:
+    mhash_deinit(h->u.md5, digest);
+    break;
+  case ALGO_XXH128:
+    xxh3->digest(h->u.xxh, digest);
+    xxh3->release(h->u.xxh);
+    break;
+  case ALGO_BLAKE3:
+    blake3_final(&h->u.b3, digest, HASH_LEN);
+    break;
+  } // switch()
+} // hash_final()
+
+void
+hash_copy(hash_t *to, const hash_t *from)
+{ /* a new state, to, that has had all that from has had. Both are to
+   * be finished by hash_final(). */
+  to->algo = from->algo;
+  switch (from->algo) {
+  case ALGO_MD5:
+    to->u.md5 = mhash_cp(from->u.md5);
+    if (to->u.md5 == MHASH_FAILED) {
+      perror("mhash_cp");
+      exit(EXIT_FAILURE);
+    }
+    break;
+  case ALGO_XXH128:
+    to->u.xxh = xxh3->create();
+    if (!to->u.xxh) {
+      perror("XXH3_createState");
+      exit(EXIT_FAILURE);
+    }
+    xxh3->copy(to->u.xxh, from->u.xxh);
+    break;
+  case ALGO_BLAKE3:
+    to->u.b3 = from->u.b3;
+    break;
+  } // switch()
+} // hash_copy()
+
+int
+hash_lanes(void)
+{ /* messages hash_many() works on together, 1 if it does them in turn. */
+  return (algo == ALGO_MD5) ? md5mb->lanes : 1;
+} // hash_lanes()
+
+void
+hash_many(const unsigned char **msg, const size_t *len, int n,
+          unsigned char (*digest)[HASH_LEN])
+{ /* the digests of n messages, each held whole in memory. MD5 does them
+   * side by side, see md5mb.h. */
+  if (algo == ALGO_MD5) {
+    md5mb->run(msg, len, n, digest);
+    return;
+  }
+  int i;
+  for (i = 0; i < n; i++) {
+    hash_t h;
+    hash_start(&h);
+    hash_update(&h, msg[i], len[i]);
+    hash_final(&h, digest[i]);
+  }
+} // hash_many()
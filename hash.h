@@ -0,0 +1,96 @@
+/*    hash.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of hash.[h|c] is to give one interface to the digest
+ * algorithms filedups can use: MD5, through libmhash, which is the
+ * default and what earlier lists hold; XXH3 128 bit from the vendored
+ * xxhash.h, with its SSE2, AVX2 or AVX512 code chosen to suit the cpu
+ * at run time; and BLAKE3, see blake3.h, cut to 128 bits. Every digest
+ * is 16 bytes. The algorithm is chosen once, by hash_select(), before
+ * any hashing starts; hash_t states are then independent of each other.
+ * hash_copy() forks a state, so that two digests can share a prefix.
+ * hash_many() takes many small messages at once, which MD5 hashes in
+ * the lanes of the widest vectors the cpu has, see md5mb.h.
+ * */
+
+#ifndef _HASH_H
+#define _HASH_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mhash.h>
+#include "blake3.h"
+
+#define HASH_LEN 16
+
+enum hash_algos {
+  ALGO_MD5,
+  ALGO_XXH128,
+  ALGO_BLAKE3,
+  ALGO_COUNT
+};
+
+typedef struct hash_t {
+  int algo;
+  union {
+    MHASH md5;
+    void *xxh;    // see xxh3.h.
+    blake3_t b3;
+  } u;
+} hash_t;
+
+int
+hash_byname(const char *name);
+
+void
+hash_select(int algo);
+
+int
+hash_selected(void);
+
+const char
+*hash_label(void);
+
+const char
+*hash_describe(void);
+
+void
+hash_start(hash_t *h);
+
+void
+hash_update(hash_t *h, const void *p, size_t n);
+
+void
+hash_final(hash_t *h, unsigned char *digest);
+
+void
+hash_copy(hash_t *to, const hash_t *from);
+
+int
+hash_lanes(void);
+
+void
+hash_many(const unsigned char **msg, const size_t *len, int n,
+          unsigned char (*digest)[HASH_LEN]);
+
+#endif
@@ -0,0 +1,232 @@
+/*    lockstep.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of lockstep.[h|c] is to compare files by reading them
+ * side by side. See lockstep.h.
+ * */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "hash.h"
+#include "lockstep.h"
+
+typedef struct ls_t {  // the files being compared.
+  int n;
+  const char **paths;
+  int fd[LOCKSTEP_MAX];
+  unsigned char *buf[LOCKSTEP_MAX];
+  int *set;              // see lockstep().
+  hash_t td[LOCKSTEP_MAX];  // the digest of each set,
+  int nsets;             // of which there are this many.
+} ls_t;
+
+static tb_t *throttle;  // see lockstep_throttle().
+
+static void
+step(ls_t *ls, off_t pos, size_t len, int add);
+static void
+refine(ls_t *ls, size_t len, int add);
+static int
+read_chunk(int fd, unsigned char *buf, size_t len, off_t pos);
+
+int
+lockstep(const char **paths, int n, size_t size, size_t first,
+         size_t chunk, int *set, md5_t *md5)
+{ /* Compare the n files at paths, all of size bytes, first bytes of
+   * each to begin with and then in chunks twice as big each time, up to
+   * chunk bytes. Returns the number of sets of two or more files with
+   * the same content; set[i] is the set of paths[i], or -1 if it
+   * matches no other file or can not be read. md5[i] is the digest of
+   * the whole file for each file in a set.
+  */
+  ls_t ls;
+  int i, live = 0;
+  if (n > LOCKSTEP_MAX) {
+    fprintf(stderr, "lockstep(): %d files, no more than %d allowed.\n",
+            n, LOCKSTEP_MAX);
+    exit(EXIT_FAILURE);
+  }
+  if (first < 1) first = 1;
+  if (chunk < first) chunk = first;
+  if (chunk > size && size) chunk = size;
+  ls.n = n;
+  ls.paths = paths;
+  ls.set = set;
+  ls.nsets = 0;
+  for (i = 0; i < n; i++) {
+    ls.buf[i] = NULL;
+    set[i] = -1;
+    ls.fd[i] = open(paths[i], O_RDONLY);
+    if (ls.fd[i] == -1) {
+      perror(paths[i]); // It's ok if a file or so goes AWL.
+      continue;
+    }
+    posix_fadvise(ls.fd[i], 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (posix_memalign((void **)&ls.buf[i], 4096, chunk)) {
+      perror("posix_memalign");
+      exit(EXIT_FAILURE);
+    }
+    set[i] = 0;
+    live++;
+  }
+  if (live > 1) {
+    hash_start(&ls.td[0]);
+    ls.nsets = 1;
+  } else {
+    for (i = 0; i < n; i++) set[i] = -1;
+  }
+  size_t len = first;
+  off_t pos;
+  for (pos = 0; ls.nsets && (size_t)pos < size; pos += len) {
+    if (pos) len = (len * 2 < chunk) ? len * 2 : chunk;
+    if ((size_t)pos + len > size) len = size - pos;
+    step(&ls, pos, len, 1);
+    if (!pos && size >= 3 * first && ls.nsets) { // then the tail.
+      step(&ls, size - first, first, 0);
+    }
+  } // for(pos...)
+  int s;
+  for (s = 0; s < ls.nsets; s++) {
+    unsigned char hash[HASH_LEN];
+    hash_final(&ls.td[s], hash);
+    for (i = 0; i < n; i++) {
+      if (set[i] == s) md5set(&md5[i], hash);
+    }
+  }
+  for (i = 0; i < n; i++) {
+    if (ls.fd[i] != -1) close(ls.fd[i]);
+    free(ls.buf[i]);
+  }
+  return ls.nsets;
+} // lockstep()
+
+static void
+step(ls_t *ls, off_t pos, size_t len, int add)
+{ /* Read len bytes at pos of each file still in a set and split the
+   * sets by what was read; add is set if it is next in the digests. */
+  int i;
+  for (i = 0; i < ls->n; i++) {
+    if (ls->set[i] == -1) continue;
+    tb_take(throttle, len);
+    if (read_chunk(ls->fd[i], ls->buf[i], len, pos) == -1) {
+      perror(ls->paths[i]);
+      ls->set[i] = -1;
+    }
+  }
+  refine(ls, len, add);
+  for (i = 0; i < ls->n; i++) { // those left on their own are done with.
+    if (ls->set[i] == -1 && ls->fd[i] != -1) {
+      close(ls->fd[i]);
+      ls->fd[i] = -1;
+    }
+  }
+} // step()
+
+static void
+refine(ls_t *ls, size_t len, int add)
+{ /* Split each set by the chunk its members have just read, and with
+   * add, add the chunk to the digest of each set that is left. A new
+   * set takes a copy of the digest of the set it came from, made before
+   * the chunk is added. The sets are numbered afresh; a file on its own
+   * has its set made -1.
+  */
+  int lead[LOCKSTEP_MAX];   // the first file of each new set,
+  int from[LOCKSTEP_MAX];   // the set it came from,
+  int count[LOCKSTEP_MAX];  // and how many files it has.
+  int taken[LOCKSTEP_MAX];  // set if an old digest has been passed on.
+  hash_t ntd[LOCKSTEP_MAX];
+  int *set = ls->set;
+  int i, s, k = 0;
+  for (i = 0; i < ls->n; i++) {
+    if (set[i] == -1) continue;
+    for (s = 0; s < k; s++) {
+      if (from[s] == set[i] &&
+          memcmp(ls->buf[i], ls->buf[lead[s]], len) == 0) break;
+    }
+    if (s == k) {
+      lead[k] = i;
+      from[k] = set[i];
+      count[k] = 0;
+      k++;
+    }
+    count[s]++;
+    set[i] = s;
+  } // for(i...)
+  memset(taken, 0, sizeof(taken));
+  for (s = 0; s < k; s++) { // copies first, the old digest goes last.
+    if (count[s] < 2) continue;
+    if (taken[from[s]]) hash_copy(&ntd[s], &ls->td[from[s]]);
+    taken[from[s]] = 1;
+  }
+  memset(taken, 0, sizeof(taken));
+  for (s = 0; s < k; s++) {
+    if (count[s] < 2 || taken[from[s]]) continue;
+    ntd[s] = ls->td[from[s]];
+    taken[from[s]] = 1;
+  }
+  for (s = 0; s < ls->nsets; s++) { // the digests of sets none are left.
+    if (!taken[s]) {
+      unsigned char hash[HASH_LEN];
+      hash_final(&ls->td[s], hash);
+    }
+  }
+  int renum[LOCKSTEP_MAX];
+  int m = 0;
+  for (s = 0; s < k; s++) {
+    if (count[s] < 2) {
+      renum[s] = -1;
+      continue;
+    }
+    renum[s] = m;
+    ls->td[m] = ntd[s];
+    if (add) hash_update(&ls->td[m], ls->buf[lead[s]], len);
+    m++;
+  }
+  for (i = 0; i < ls->n; i++) {
+    if (set[i] != -1) set[i] = renum[set[i]];
+  }
+  ls->nsets = m;
+} // refine()
+
+static int
+read_chunk(int fd, unsigned char *buf, size_t len, off_t pos)
+{ /* Read all len bytes at pos. Returns 0, or -1 with errno set; a file
+   * that has got shorter gives EIO. */
+  size_t got = 0;
+  while (got < len) {
+    ssize_t r = pread(fd, buf + got, len - got, pos + got);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) return -1;
+    if (r == 0) {
+      errno = EIO;
+      return -1;
+    }
+    got += r;
+  }
+  return 0;
+} // read_chunk()
+
+void
+lockstep_throttle(tb_t *tb)
+{ /* Hold reading to the rate of tb, in bytes a second. To be called
+   * before any comparing starts. */
+  throttle = tb;
+} // lockstep_throttle()
@@ -0,0 +1,53 @@
+/*    lockstep.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of lockstep.[h|c] is to sort a few files of one size
+ * into sets of identical content by reading them side by side, a chunk
+ * of each at a time, and comparing the chunks byte for byte. A set is
+ * split as soon as its members differ and a file left on its own is
+ * read no further, so big files that differ early cost little. The
+ * first chunk is small and the chunks grow from there, and the last
+ * small chunk is compared straight after the first, so a difference at
+ * either end is found as cheaply as by the head and tail hashes. Each
+ * set's digest is made from one copy of its chunks, by the algorithm of
+ * hash_select(), and is forked by hash_copy() when the set splits; so
+ * the digests are those calcmd5() gives each file.
+ * */
+
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calcmd5.h"
+#include "throttle.h"
+
+#define LOCKSTEP_MAX 8  // files that can be compared at once.
+
+int
+lockstep(const char **paths, int n, size_t size, size_t first,
+         size_t chunk, int *set, md5_t *md5);
+
+void
+lockstep_throttle(tb_t *tb);
+
+#endif
@@ -0,0 +1,48 @@
+/*    md5mb.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of md5mb.h is to declare the multi-buffer MD5 code built
+ * by md5mb_base.c, md5mb_avx2.c and md5mb_avx512.c from md5mbimpl.h,
+ * each for one instruction set. MD5 can not be sped up within one
+ * message, each step needing the one before, but the steps of several
+ * messages can be worked together, one message in each lane of a
+ * vector: 4 lanes with SSE2, 8 with AVX2 and 16 with AVX512. hash.c
+ * picks one at run time. The digests are those of any other MD5.
+ * */
+
+#ifndef _MD5MB_H
+#define _MD5MB_H
+#include <stddef.h>
+
+typedef struct md5mb_ops_t {
+  const char *isa;
+  int lanes;
+  /* the digests of n messages, each of 16 bytes. */
+  void (*run)(const unsigned char **msg, const size_t *len, int n,
+              unsigned char (*digest)[16]);
+} md5mb_ops_t;
+
+extern const md5mb_ops_t md5mb_base;
+#if defined(__x86_64__) || defined(__i386__)
+extern const md5mb_ops_t md5mb_avx2;
+extern const md5mb_ops_t md5mb_avx512;
+#endif
+
+#endif
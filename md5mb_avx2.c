@@ -0,0 +1,31 @@
+/*    md5mb_avx2.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of md5mb_avx2.c is to build multi-buffer MD5 with 8 lanes
+ * of AVX2, to be used only when the cpu has it. See md5mb.h.
+ * */
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC target("avx2")
+#define MD5MB_OPS md5mb_avx2
+#define MD5MB_ISA "avx2"
+#define MD5MB_LANES 8
+#include "md5mbimpl.h"
+#endif
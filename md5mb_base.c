@@ -0,0 +1,29 @@
+/*    md5mb_base.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of md5mb_base.c is to build multi-buffer MD5 for the
+ * instruction set the whole program is compiled for, 4 lanes of SSE2
+ * on x86_64. See md5mb.h.
+ * */
+
+#define MD5MB_OPS md5mb_base
+#define MD5MB_ISA "base"
+#define MD5MB_LANES 4
+#include "md5mbimpl.h"
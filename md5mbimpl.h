@@ -0,0 +1,192 @@
+/*    md5mbimpl.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of md5mbimpl.h is to be included once by each of the
+ * md5mb_*.c files, after any target pragma, to build multi-buffer MD5
+ * with MD5MB_LANES lanes for that instruction set, as MD5MB_OPS. The
+ * vectors are GCC's generic ones, so the compiler picks the
+ * instructions. A lane takes the next message as soon as it is done
+ * with one, so messages of mixed lengths keep the lanes busy.
+ * */
+
+#include <stdint.h>
+#include <string.h>
+#include "md5mb.h"
+
+typedef uint32_t vec_t __attribute__((vector_size(MD5MB_LANES * 4)));
+
+typedef struct lane_t {   // a message being hashed in a lane.
+  int msg;                // its index, or -1 for an idle lane.
+  const unsigned char *p; // the next whole block of it,
+  size_t full;            // and how many are left.
+  int tails;              // padded blocks to follow, 1 or 2,
+  int t;                  // of which this is the next.
+  unsigned char tail[128];
+} lane_t;
+
+static const unsigned char zero_block[64];
+
+static const uint32_t K[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+  0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+  0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+  0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+  0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+  0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+#define F(x, y, z) ((((y) ^ (z)) & (x)) ^ (z))
+#define G(x, y, z) ((((x) ^ (y)) & (z)) ^ (y))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define STEP(f, a, b, c, d, k, i, s) \
+  a += f(b, c, d) + w[k] + K[i]; \
+  a = ((a << s) | (a >> (32 - s))) + b;
+
+static void
+mb_blocks(vec_t *st, const unsigned char **blk)
+{ /* One 64 byte block for each lane into the states st[4]. */
+  uint32_t m[16][MD5MB_LANES] __attribute__((aligned(64)));
+  vec_t w[16];
+  int j, l;
+  for (l = 0; l < MD5MB_LANES; l++) {
+    const unsigned char *p = blk[l];
+    for (j = 0; j < 16; j++, p += 4) {
+      m[j][l] = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+                | (uint32_t)p[3] << 24;
+    }
+  }
+  memcpy(w, m, sizeof(w));
+  vec_t a = st[0], b = st[1], c = st[2], d = st[3];
+  STEP(F, a, b, c, d, 0, 0, 7)   STEP(F, d, a, b, c, 1, 1, 12)
+  STEP(F, c, d, a, b, 2, 2, 17)  STEP(F, b, c, d, a, 3, 3, 22)
+  STEP(F, a, b, c, d, 4, 4, 7)   STEP(F, d, a, b, c, 5, 5, 12)
+  STEP(F, c, d, a, b, 6, 6, 17)  STEP(F, b, c, d, a, 7, 7, 22)
+  STEP(F, a, b, c, d, 8, 8, 7)   STEP(F, d, a, b, c, 9, 9, 12)
+  STEP(F, c, d, a, b, 10, 10, 17) STEP(F, b, c, d, a, 11, 11, 22)
+  STEP(F, a, b, c, d, 12, 12, 7) STEP(F, d, a, b, c, 13, 13, 12)
+  STEP(F, c, d, a, b, 14, 14, 17) STEP(F, b, c, d, a, 15, 15, 22)
+  STEP(G, a, b, c, d, 1, 16, 5)  STEP(G, d, a, b, c, 6, 17, 9)
+  STEP(G, c, d, a, b, 11, 18, 14) STEP(G, b, c, d, a, 0, 19, 20)
+  STEP(G, a, b, c, d, 5, 20, 5)  STEP(G, d, a, b, c, 10, 21, 9)
+  STEP(G, c, d, a, b, 15, 22, 14) STEP(G, b, c, d, a, 4, 23, 20)
+  STEP(G, a, b, c, d, 9, 24, 5)  STEP(G, d, a, b, c, 14, 25, 9)
+  STEP(G, c, d, a, b, 3, 26, 14) STEP(G, b, c, d, a, 8, 27, 20)
+  STEP(G, a, b, c, d, 13, 28, 5) STEP(G, d, a, b, c, 2, 29, 9)
+  STEP(G, c, d, a, b, 7, 30, 14) STEP(G, b, c, d, a, 12, 31, 20)
+  STEP(H, a, b, c, d, 5, 32, 4)  STEP(H, d, a, b, c, 8, 33, 11)
+  STEP(H, c, d, a, b, 11, 34, 16) STEP(H, b, c, d, a, 14, 35, 23)
+  STEP(H, a, b, c, d, 1, 36, 4)  STEP(H, d, a, b, c, 4, 37, 11)
+  STEP(H, c, d, a, b, 7, 38, 16) STEP(H, b, c, d, a, 10, 39, 23)
+  STEP(H, a, b, c, d, 13, 40, 4) STEP(H, d, a, b, c, 0, 41, 11)
+  STEP(H, c, d, a, b, 3, 42, 16) STEP(H, b, c, d, a, 6, 43, 23)
+  STEP(H, a, b, c, d, 9, 44, 4)  STEP(H, d, a, b, c, 12, 45, 11)
+  STEP(H, c, d, a, b, 15, 46, 16) STEP(H, b, c, d, a, 2, 47, 23)
+  STEP(I, a, b, c, d, 0, 48, 6)  STEP(I, d, a, b, c, 7, 49, 10)
+  STEP(I, c, d, a, b, 14, 50, 15) STEP(I, b, c, d, a, 5, 51, 21)
+  STEP(I, a, b, c, d, 12, 52, 6) STEP(I, d, a, b, c, 3, 53, 10)
+  STEP(I, c, d, a, b, 10, 54, 15) STEP(I, b, c, d, a, 1, 55, 21)
+  STEP(I, a, b, c, d, 8, 56, 6)  STEP(I, d, a, b, c, 15, 57, 10)
+  STEP(I, c, d, a, b, 6, 58, 15) STEP(I, b, c, d, a, 13, 59, 21)
+  STEP(I, a, b, c, d, 4, 60, 6)  STEP(I, d, a, b, c, 11, 61, 10)
+  STEP(I, c, d, a, b, 2, 62, 15) STEP(I, b, c, d, a, 9, 63, 21)
+  st[0] += a;
+  st[1] += b;
+  st[2] += c;
+  st[3] += d;
+} // mb_blocks()
+
+static void
+mb_start(lane_t *ln, vec_t *st, int l, int msg, const unsigned char *p,
+         size_t len)
+{ /* Put message msg, of len bytes at p, into lane l. Its last bytes go
+   * into the lane's tail with the padding and the length in bits. */
+  size_t rest = len % 64;
+  uint64_t bits = (uint64_t)len * 8;
+  int i;
+  ln->msg = msg;
+  ln->p = p;
+  ln->full = len / 64;
+  ln->tails = (rest < 56) ? 1 : 2;
+  ln->t = 0;
+  memset(ln->tail, 0, sizeof(ln->tail));
+  memcpy(ln->tail, p + len - rest, rest);
+  ln->tail[rest] = 0x80;
+  for (i = 0; i < 8; i++) {
+    ln->tail[ln->tails * 64 - 8 + i] = (unsigned char)(bits >> (8 * i));
+  }
+  st[0][l] = 0x67452301;
+  st[1][l] = 0xefcdab89;
+  st[2][l] = 0x98badcfe;
+  st[3][l] = 0x10325476;
+} // mb_start()
+
+static void
+mb_run(const unsigned char **msg, const size_t *len, int n,
+       unsigned char (*digest)[16])
+{ /* Hash the n messages, MD5MB_LANES at a time, into digest. */
+  lane_t ln[MD5MB_LANES];
+  const unsigned char *blk[MD5MB_LANES];
+  vec_t st[4];
+  int l, next = 0;
+  memset(st, 0, sizeof(st));
+  for (l = 0; l < MD5MB_LANES; l++) ln[l].msg = -1;
+  while (1) {
+    int busy = 0;
+    for (l = 0; l < MD5MB_LANES; l++) {
+      if (ln[l].msg == -1 && next < n) {
+        mb_start(&ln[l], st, l, next, msg[next], len[next]);
+        next++;
+      }
+      if (ln[l].msg == -1) {
+        blk[l] = zero_block;
+        continue;
+      }
+      busy++;
+      blk[l] = (ln[l].full) ? ln[l].p : ln[l].tail + ln[l].t * 64;
+    } // for(l...)
+    if (!busy) break;
+    mb_blocks(st, blk);
+    for (l = 0; l < MD5MB_LANES; l++) {
+      lane_t *x = &ln[l];
+      if (x->msg == -1) continue;
+      if (x->full) {
+        x->full--;
+        x->p += 64;
+        continue;
+      }
+      if (++x->t < x->tails) continue;
+      int i, j;
+      for (i = 0; i < 4; i++) {
+        for (j = 0; j < 4; j++) {
+          digest[x->msg][i * 4 + j] = (unsigned char)(st[i][l] >> (8 * j));
+        }
+      }
+      x->msg = -1;
+    } // for(l...)
+  } // while()
+} // mb_run()
+
+const md5mb_ops_t MD5MB_OPS = { MD5MB_ISA, MD5MB_LANES, mb_run };
@@ -0,0 +1,125 @@
+/*    pathstore.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of pathstore.[h|c] is to keep the paths of many files
+ * compactly. See pathstore.h.
+ * */
+
+#include "pathstore.h"
+
+static void
+*grow(void *p, uint32_t *cap, size_t size);
+
+pathstore_t
+*ps_init(int hugepages)
+{ /* an empty store. */
+  pathstore_t *ps = xcalloc(1, sizeof(struct pathstore_t));
+  ps->names = arena_init(hugepages);
+  return ps;
+} // ps_init()
+
+void
+ps_free(pathstore_t *ps)
+{ /* release the store and its names. */
+  if (!ps) return;
+  arena_free(ps->names);
+  free(ps->dirs);
+  free(ps->files);
+  free(ps);
+} // ps_free()
+
+static void
+*grow(void *p, uint32_t *cap, size_t size)
+{ /* double the capacity of a table. */
+  if (*cap >= UINT32_MAX / 2) {
+    fputs("Too many paths for the path store.\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  *cap = (*cap) ? 2 * *cap : 4096;
+  p = realloc(p, (size_t)*cap * size);
+  if (!p) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+} // grow()
+
+uint32_t
+ps_add_dir(pathstore_t *ps, uint32_t parent, const char *name)
+{ /* record a dir, returning its index. */
+  if (ps->ndirs == ps->dcap) {
+    ps->dirs = grow(ps->dirs, &ps->dcap, sizeof(struct psdir_t));
+  }
+  ps->dirs[ps->ndirs].name = arena_strdup(ps->names, name);
+  ps->dirs[ps->ndirs].parent = parent;
+  return ps->ndirs++;
+} // ps_add_dir()
+
+uint32_t
+ps_add_file(pathstore_t *ps, uint32_t dir, const char *name)
+{ /* record a file, returning its handle. */
+  if (ps->nfiles == ps->fcap) {
+    ps->files = grow(ps->files, &ps->fcap, sizeof(struct psfile_t));
+  }
+  ps->files[ps->nfiles].name = arena_strdup(ps->names, name);
+  ps->files[ps->nfiles].dir = dir;
+  return ps->nfiles++;
+} // ps_add_file()
+
+char
+*ps_path(const pathstore_t *ps, uint32_t file, char *buf)
+{ /* Put the full path of file into buf, which must be PATH_MAX long.
+   * The components are collected leaf first, then copied out root
+   * first.
+  */
+  const char *comp[PATH_MAX / 2];
+  int n = 0;
+  comp[n++] = ps->files[file].name;
+  uint32_t d = ps->files[file].dir;
+  while (d != PS_ROOT && n < PATH_MAX / 2) {
+    comp[n++] = ps->dirs[d].name;
+    d = ps->dirs[d].parent;
+  }
+  char *cp = buf;
+  char *limit = buf + PATH_MAX - 1;
+  while (n--) {
+    size_t len = strlen(comp[n]);
+    if (cp + len + 1 > limit) {
+      *cp = 0;
+      fprintf(stderr, "Path too long: %s ...\n", buf);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(cp, comp[n], len);
+    cp += len;
+    if (n) *cp++ = '/';
+  }
+  *cp = 0;
+  return buf;
+} // ps_path()
+
+void
+ps_report(const pathstore_t *ps)
+{ /* tell the user how much memory the store is using. */
+  arena_report(ps->names, "Path names");
+  fprintf(stderr, "Path store: %u dirs, %u files, %lu bytes of tables.\n",
+          ps->ndirs, ps->nfiles,
+          (size_t)ps->dcap * sizeof(psdir_t)
+          + (size_t)ps->fcap * sizeof(psfile_t));
+} // ps_report()
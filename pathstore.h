@@ -0,0 +1,80 @@
+/*    pathstore.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of pathstore.[h|c] is to keep the paths of many files
+ * compactly. Each directory is stored once, as its own name and the
+ * index of its parent; each file is stored as its basename and the
+ * index of its directory. A file is known by a 32 bit handle and its
+ * full path is put together only when it is needed, by ps_path().
+ * The names themselves are kept in an arena, see arena.h.
+ * */
+
+#ifndef _PATHSTORE_H
+#define _PATHSTORE_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "str.h"
+#include "arena.h"
+
+#define PS_ROOT UINT32_MAX  // parent of a top level dir.
+
+typedef struct psdir_t {
+  char *name;       // a top level dir has its full path here.
+  uint32_t parent;
+} psdir_t;
+
+typedef struct psfile_t {
+  char *name;
+  uint32_t dir;
+} psfile_t;
+
+typedef struct pathstore_t {
+  arena_t *names;
+  psdir_t *dirs;
+  uint32_t ndirs;
+  uint32_t dcap;
+  psfile_t *files;
+  uint32_t nfiles;
+  uint32_t fcap;
+} pathstore_t;
+
+pathstore_t
+*ps_init(int hugepages);
+
+void
+ps_free(pathstore_t *ps);
+
+uint32_t
+ps_add_dir(pathstore_t *ps, uint32_t parent, const char *name);
+
+uint32_t
+ps_add_file(pathstore_t *ps, uint32_t dir, const char *name);
+
+char
+*ps_path(const pathstore_t *ps, uint32_t file, char *buf);
+
+void
+ps_report(const pathstore_t *ps);
+
+#endif
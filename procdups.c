@@ -172,14 +172,14 @@ actondups(char **items)
   int i = 0;
   while (items[i]) {
     dosystem("/usr/bin/clear");
-    char sumbuf[33];
-    strncpy(sumbuf, items[i], 32);
-    sumbuf[32] = '\0';
-    fprintf(stdout, "md5sum: %s\n", sumbuf);
+    /* The digest is the first field; any but an md5sum is prefixed by
+     * the name of its algorithm. */
+    size_t sumlen = strcspn(items[i], "\t");
+    fprintf(stdout, "digest: %.*s\n", (int)sumlen, items[i]);
     fprintf(stdout, "%s\n", showline(items[i]));
     int first = i;
     int j = i + 1;
-    while ((items[j] && strncmp(items[first], items[j], 8) == 0)) {
+    while ((items[j] && strncmp(items[first], items[j], sumlen + 1) == 0)) {
       fprintf(stdout, "%s\n", showline(items[j]));
       j++;
     }
@@ -226,7 +226,7 @@ static char
 { /* breaks the data line into separate fields for display. */
   char work[PATH_MAX + 128];
   static char out[2 * PATH_MAX];
-  strcpy(work, s+33);
+  strcpy(work, strchr(s, '\t') + 1);
   char *fr = work;
   char *to = strchr(work, '\t'); *to = '\0';
   strcpy(out, "inode ");
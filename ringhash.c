@@ -0,0 +1,254 @@
+/*    ringhash.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of ringhash.[h|c] is to hash files with the reads made
+ * through io_uring. See ringhash.h.
+ * */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "hash.h"
+#include "uring.h"
+#include "ringhash.h"
+
+enum rh_states {
+  RH_IDLE,
+  RH_OPEN,
+  RH_READ
+};
+
+typedef struct rhslot_t {
+  rhreq_t rq;
+  hash_t h;
+  int state;              // one of enum rh_states.
+  int fd;
+  off_t pos;              // the offset of the next read.
+  off_t left;             // bytes still to hash, -1 for to the end.
+  unsigned char *buf;
+  struct iovec iov;       // buf, for IORING_OP_READV.
+} rhslot_t;
+
+typedef struct rh_t {
+  uring_t *r;
+  rhslot_t *slots;
+  int fixed;              // the buffers are registered.
+  int async_open;         // the kernel has IORING_OP_OPENAT.
+  int busy;               // slots not RH_IDLE.
+  rh_next_f next;
+  rh_done_f done;
+  void *arg;
+} rh_t;
+
+static tb_t *throttle; // a token for each byte read, NULL for no limit.
+
+static void
+start_file(rh_t *rh, unsigned slot);
+static void
+submit_open(rh_t *rh, unsigned slot);
+static void
+submit_read(rh_t *rh, unsigned slot);
+static void
+end_file(rh_t *rh, unsigned slot, int err);
+static void
+finish(rh_t *rh, unsigned slot, int err);
+static void
+completed(rh_t *rh, unsigned slot, int res);
+
+int
+ringhash(unsigned depth, rh_next_f next, rh_done_f done, void *arg)
+{ /* Hash the files next() gives, up to depth of them at once, handing
+   * each to done(). Returns 1 once all are done, or 0, with nothing
+   * asked of next(), if the kernel can not supply a ring.
+  */
+  rh_t rh = { NULL, NULL, 1, 1, 0, next, done, arg };
+  rh.r = uring_init(depth);
+  if (!rh.r) return 0;
+  rh.slots = xcalloc(depth, sizeof(rhslot_t));
+  unsigned char *bufs;
+  if (posix_memalign((void **)&bufs, 4096, (size_t)depth * RH_BUFSZ)) {
+    perror("posix_memalign");
+    exit(EXIT_FAILURE);
+  }
+  unsigned s;
+  for (s = 0; s < depth; s++) {
+    rh.slots[s].buf = bufs + (size_t)s * RH_BUFSZ;
+    rh.slots[s].iov.iov_base = rh.slots[s].buf;
+    rh.slots[s].iov.iov_len = RH_BUFSZ;
+  }
+  struct iovec *iov = xcalloc(depth, sizeof(struct iovec));
+  for (s = 0; s < depth; s++) iov[s] = rh.slots[s].iov;
+  // Without the pinned buffers the plain reads are only a little slower.
+  if (uring_register_buffers(rh.r, iov, depth) == -1) rh.fixed = 0;
+  free(iov);
+  for (s = 0; s < depth; s++) start_file(&rh, s);
+  while (rh.busy) {
+    // what the kernel does not take now goes again on the next pass.
+    if (uring_submit(rh.r, 1) == -1) {
+      perror("io_uring_enter");
+      exit(EXIT_FAILURE);
+    }
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(rh.r))) {
+      unsigned slot = cqe->user_data;
+      int res = cqe->res;
+      uring_cqe_seen(rh.r);
+      completed(&rh, slot, res);
+    } // while(reaping)
+  } // while()
+  free(bufs);
+  free(rh.slots);
+  uring_free(rh.r);
+  return 1;
+} // ringhash()
+
+void
+ringhash_throttle(tb_t *tb)
+{ /* Hold reading to the rate of tb, in bytes a second. To be called
+   * before any hashing starts. */
+  throttle = tb;
+} // ringhash_throttle()
+
+static void
+start_file(rh_t *rh, unsigned slot)
+{ /* Put the next file into the slot, or leave it idle. */
+  rhslot_t *sl = &rh->slots[slot];
+  while (rh->next(&sl->rq, rh->arg)) {
+    hash_start(&sl->h);
+    if (sl->rq.plen) hash_update(&sl->h, sl->rq.prefix, sl->rq.plen);
+    sl->pos = sl->rq.from;
+    sl->left = (sl->rq.pages > 0) ? (off_t)sl->rq.pages * 4096 : -1;
+    sl->fd = -1;
+    if (rh->async_open) {
+      submit_open(rh, slot);
+    } else if ((sl->fd = open(sl->rq.path, O_RDONLY)) != -1) {
+      submit_read(rh, slot);
+    } else {
+      finish(rh, slot, errno);
+      continue;
+    }
+    rh->busy++;
+    return;
+  } // while()
+  sl->state = RH_IDLE;
+} // start_file()
+
+static void
+submit_open(rh_t *rh, unsigned slot)
+{ /* queue the open of the slot's file. */
+  rhslot_t *sl = &rh->slots[slot];
+  struct io_uring_sqe *sqe = uring_get_sqe(rh->r); // one per slot.
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long)sl->rq.path;
+  sqe->open_flags = O_RDONLY;
+  sqe->user_data = slot;
+  sl->state = RH_OPEN;
+} // submit_open()
+
+static void
+submit_read(rh_t *rh, unsigned slot)
+{ /* queue the next read of the slot's file. */
+  rhslot_t *sl = &rh->slots[slot];
+  size_t len = RH_BUFSZ;
+  if (sl->left >= 0 && (size_t)sl->left < len) len = sl->left;
+  tb_take(throttle, len);
+  struct io_uring_sqe *sqe = uring_get_sqe(rh->r);
+  sqe->fd = sl->fd;
+  sqe->off = sl->pos;
+  if (rh->fixed) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->addr = (unsigned long)sl->buf;
+    sqe->len = len;
+    sqe->buf_index = slot;
+  } else {
+    sl->iov.iov_len = len;
+    sqe->opcode = IORING_OP_READV;
+    sqe->addr = (unsigned long)&sl->iov;
+    sqe->len = 1;
+  }
+  sqe->user_data = slot;
+  sl->state = RH_READ;
+} // submit_read()
+
+static void
+completed(rh_t *rh, unsigned slot, int res)
+{ /* Act on the result of the slot's open or read. */
+  rhslot_t *sl = &rh->slots[slot];
+  if (sl->state == RH_OPEN) {
+    if (res == -EINVAL || res == -EOPNOTSUPP) { // no IORING_OP_OPENAT.
+      rh->async_open = 0;
+      res = open(sl->rq.path, O_RDONLY);
+      if (res == -1) res = -errno;
+    }
+    if (res < 0) {
+      end_file(rh, slot, -res);
+      return;
+    }
+    sl->fd = res;
+    submit_read(rh, slot);
+    return;
+  }
+  if (res == -EINTR || res == -EAGAIN) {
+    submit_read(rh, slot);
+    return;
+  }
+  if (res < 0) {
+    end_file(rh, slot, -res);
+    return;
+  }
+  if (res > 0) {
+    hash_update(&sl->h, sl->buf, res);
+    sl->pos += res;
+    if (sl->left > 0) sl->left -= res;
+  }
+  if (res == 0 || sl->left == 0) {
+    end_file(rh, slot, 0);
+    return;
+  }
+  submit_read(rh, slot);
+} // completed()
+
+static void
+end_file(rh_t *rh, unsigned slot, int err)
+{ /* Finish the slot's file and start the next. */
+  finish(rh, slot, err);
+  rh->busy--;
+  start_file(rh, slot);
+} // end_file()
+
+static void
+finish(rh_t *rh, unsigned slot, int err)
+{ /* Finish the slot's file, with err the errno of a failure or 0, and
+   * hand it to done(). */
+  rhslot_t *sl = &rh->slots[slot];
+  unsigned char hash[HASH_LEN];
+  if (sl->fd != -1) close(sl->fd);
+  hash_final(&sl->h, hash); // the state is released either way.
+  if (err) {
+    fprintf(stderr, "%s: %s\n", sl->rq.path, strerror(err));
+    memset(&sl->rq.md5, 0, sizeof(md5_t));
+    sl->rq.bad = 1;
+  } else {
+    md5set(&sl->rq.md5, hash);
+    sl->rq.bad = 0;
+  }
+  rh->done(&sl->rq, rh->arg);
+} // finish()
@@ -0,0 +1,66 @@
+/*    ringhash.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of ringhash.[h|c] is to hash many files at once from one
+ * thread, with io_uring(7) doing the reading. Up to depth files are
+ * open together, each with a read of up to RH_BUFSZ in flight into a
+ * buffer registered with the ring, and each completed buffer is hashed
+ * while the others are still being read. The opens go through the
+ * ring too. So on a tree of small files, where each file costs an open
+ * and a read or two, the device is kept busy rather than waiting on
+ * one file at a time. The digests are those calcmd5_block() gives.
+ * */
+
+#ifndef _RINGHASH_H
+#define _RINGHASH_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h>
+#include "calcmd5.h"
+#include "throttle.h"
+
+#define RH_BUFSZ (128 * 1024)
+
+typedef struct rhreq_t {  // a file to hash, as for calcmd5_block().
+  char path[PATH_MAX];
+  unsigned char prefix[16];
+  size_t plen;
+  off_t from;
+  int pages;              // pages of 4096 to hash, < 1 for to the end.
+  md5_t md5;              // the digest, once done.
+  int bad;                // set if the file could not be read.
+  int tag;                // the caller's.
+} rhreq_t;
+
+/* Fills in the next file to hash, returns 0 if there are no more. */
+typedef int (*rh_next_f)(rhreq_t *rq, void *arg);
+/* Receives each file once it is hashed, or has failed. */
+typedef void (*rh_done_f)(const rhreq_t *rq, void *arg);
+
+int
+ringhash(unsigned depth, rh_next_f next, rh_done_f done, void *arg);
+
+void
+ringhash_throttle(tb_t *tb);
+
+#endif
@@ -0,0 +1,148 @@
+/*    rsort.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of rsort.[h|c] is to radix sort arrays of small structs
+ * keyed on 64 bit words. See rsort.h.
+ * */
+
+#include "rsort.h"
+
+typedef struct rteam_t {
+  const rsort_t *how;
+  char *base;
+  char *tmp;
+  size_t n;
+  int nthreads;
+  size_t (*hist)[256];  // counts, then offsets, for each thread.
+  pthread_barrier_t bar;
+  int skip;             // the current pass has nothing to do.
+  char *result;         // where the sorted elements ended up.
+} rteam_t;
+
+typedef struct rmember_t {
+  rteam_t *team;
+  int id;
+} rmember_t;
+
+static void
+*member(void *p);
+
+static inline unsigned
+digit(const rsort_t *how, const char *elem, int w, int b)
+{ /* byte b, counting from the least significant, of key word w. */
+  uint64_t word;
+  memcpy(&word, elem + how->word[w], sizeof(uint64_t));
+  return (word >> (8 * b)) & 0xff;
+} // digit()
+
+void
+rsort(void *base, size_t n, const rsort_t *how, int nthreads)
+{ /* sort n elements at base as described by how. */
+  if (n < RSORT_MIN) {
+    qsort(base, n, how->size, how->cmp);
+    return;
+  }
+  if ((size_t)nthreads > n / 1024) nthreads = n / 1024;
+  if (nthreads < 1) nthreads = 1;
+  rteam_t team;
+  memset(&team, 0, sizeof(team));
+  team.how = how;
+  team.base = base;
+  team.tmp = xmalloc(n * how->size);
+  team.n = n;
+  team.nthreads = nthreads;
+  team.hist = xcalloc(nthreads, sizeof(size_t[256]));
+  pthread_barrier_init(&team.bar, NULL, nthreads);
+  rmember_t *mem = xcalloc(nthreads, sizeof(struct rmember_t));
+  pthread_t *tids = xcalloc(nthreads, sizeof(pthread_t));
+  int i;
+  for (i = 0; i < nthreads; i++) {
+    mem[i].team = &team;
+    mem[i].id = i;
+    if (i && pthread_create(&tids[i], NULL, member, &mem[i])) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  member(&mem[0]); // the caller is member 0.
+  for (i = 1; i < nthreads; i++) pthread_join(tids[i], NULL);
+  if (team.result != team.base) memcpy(base, team.result, n * how->size);
+  pthread_barrier_destroy(&team.bar);
+  free(tids);
+  free(mem);
+  free(team.hist);
+  free(team.tmp);
+} // rsort()
+
+static void
+*member(void *p)
+{ /* One of the team. Each pass, every member counts the digits in its
+   * own slice of the array; member 0 turns the counts into offsets,
+   * then every member moves its slice to the offsets it was given.
+   * The slices are taken in order so each pass is stable.
+  */
+  rmember_t *m = p;
+  rteam_t *t = m->team;
+  const rsort_t *how = t->how;
+  size_t size = how->size;
+  size_t lo = t->n * m->id / t->nthreads;
+  size_t hi = t->n * (m->id + 1) / t->nthreads;
+  char *src = t->base;
+  char *dst = t->tmp;
+  size_t *hist = t->hist[m->id];
+  int w, b;
+  size_t i;
+  for (w = how->nwords - 1; w >= 0; w--) {
+    for (b = 0; b < 8; b++) {
+      memset(hist, 0, 256 * sizeof(size_t));
+      for (i = lo; i < hi; i++) hist[digit(how, src + i * size, w, b)]++;
+      pthread_barrier_wait(&t->bar);
+      if (m->id == 0) {
+        size_t total[256] = {0};
+        int d, k;
+        t->skip = 0;
+        for (d = 0; d < 256; d++) {
+          for (k = 0; k < t->nthreads; k++) total[d] += t->hist[k][d];
+          if (total[d] == t->n) t->skip = 1;
+        }
+        size_t pos = 0;
+        for (d = 0; d < 256 && !t->skip; d++) {
+          for (k = 0; k < t->nthreads; k++) {
+            size_t c = t->hist[k][d];
+            t->hist[k][d] = pos;
+            pos += c;
+          }
+        }
+      }
+      pthread_barrier_wait(&t->bar);
+      if (t->skip) continue;
+      for (i = lo; i < hi; i++) {
+        const char *elem = src + i * size;
+        memcpy(dst + size * hist[digit(how, elem, w, b)]++, elem, size);
+      }
+      pthread_barrier_wait(&t->bar);
+      char *swap = src;
+      src = dst;
+      dst = swap;
+    } // for(b...)
+  } // for(w...)
+  if (m->id == 0) t->result = src;
+  return NULL;
+} // member()
@@ -0,0 +1,55 @@
+/*    rsort.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of rsort.[h|c] is to sort arrays of small structs whose
+ * key is made of one or more 64 bit unsigned words. The sort is a least
+ * significant digit radix sort, one byte per pass, with the passes
+ * shared among a team of threads; a pass in which every element has
+ * the same digit is skipped. Arrays shorter than RSORT_MIN are given to
+ * qsort() with the caller's comparison function instead. Both give the
+ * same order for distinct keys.
+ * */
+
+#ifndef _RSORT_H
+#define _RSORT_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "str.h"
+
+#define RSORT_MIN 16384
+#define RSORT_MAXWORDS 4
+
+typedef struct rsort_t {
+  size_t size;    // bytes per element.
+  int nwords;     // key words per element.
+  size_t word[RSORT_MAXWORDS];  // offsets of the key words, most
+                                // significant first.
+  int (*cmp)(const void *, const void *); // for qsort().
+} rsort_t;
+
+void
+rsort(void *base, size_t n, const rsort_t *how, int nthreads);
+
+#endif
@@ -0,0 +1,184 @@
+/*    sizeidx.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of sizeidx.[h|c] is to drop files of unique size while
+ * the tree is being read. See sizeidx.h.
+ * */
+
+#include "sizeidx.h"
+
+#define SZX_MINCAP 4096
+#define SZX_HASH(size) (((size) * 0x9E3779B97F4A7C15ULL) >> 32)
+
+static szslot_t
+*lookup(szslot_t *slots, size_t cap, size_t size);
+static void
+rehash(sizeidx_t *x);
+static size_t
+probe(const uint64_t *sizes, size_t cap, size_t size);
+
+sizeidx_t
+*szx_init(void)
+{ /* an empty index. */
+  sizeidx_t *x = xcalloc(1, sizeof(struct sizeidx_t));
+  x->cap = SZX_MINCAP;
+  x->slots = xcalloc(x->cap, sizeof(struct szslot_t));
+  return x;
+} // szx_init()
+
+void
+szx_free(sizeidx_t *x)
+{ /* release the index. */
+  if (!x) return;
+  free(x->slots);
+  free(x);
+} // szx_free()
+
+static szslot_t
+*lookup(szslot_t *slots, size_t cap, size_t size)
+{ /* The slot holding size, or the empty slot where it belongs. File
+   * sizes cluster on small and round numbers so they are scattered by
+   * a Fibonacci multiply before the table is probed linearly.
+  */
+  size_t i = SZX_HASH(size);
+  for (i &= cap - 1; ; i = (i + 1) & (cap - 1)) {
+    if (slots[i].size == size || slots[i].size == 0) return &slots[i];
+  }
+} // lookup()
+
+static void
+rehash(sizeidx_t *x)
+{ /* double the table, which is kept no more than half full. */
+  size_t cap = 2 * x->cap;
+  szslot_t *slots = xcalloc(cap, sizeof(struct szslot_t));
+  size_t i;
+  for (i = 0; i < x->cap; i++) {
+    if (x->slots[i].size) *lookup(slots, cap, x->slots[i].size) = x->slots[i];
+  }
+  free(x->slots);
+  x->slots = slots;
+  x->cap = cap;
+} // rehash()
+
+uint32_t
+szx_add(sizeidx_t *x, size_t size, const szrec_t *rec, szrec_t *first)
+{ /* Count a file of size > 0. Returns the number of files of that size
+   * seen so far, this one included. At 1 rec is held as pending; at 2
+   * the pending record is copied to first and the caller must keep both
+   * it and rec; beyond that only rec is new.
+  */
+  if (2 * (x->used + 1) > x->cap) rehash(x);
+  szslot_t *s = lookup(x->slots, x->cap, size);
+  if (s->size == 0) {
+    s->size = size;
+    s->first = *rec;
+    s->count = 1;
+    x->used++;
+    x->singles++;
+    return 1;
+  }
+  if (s->count == 1) {
+    *first = s->first;
+    x->singles--;
+  }
+  if (s->count < UINT32_MAX) s->count++;
+  return s->count;
+} // szx_add()
+
+void
+szx_report(const sizeidx_t *x, size_t kept)
+{ /* tell the user what the index saved. */
+  fprintf(stderr, "Size index: %lu sizes, %lu files of unique size "
+          "dropped, %lu kept, %lu bytes of table.\n", x->used, x->singles,
+          kept, x->cap * sizeof(szslot_t));
+} // szx_report()
+
+szcount_t
+*szc_init(void)
+{ /* an empty counter. */
+  szcount_t *c = xcalloc(1, sizeof(struct szcount_t));
+  c->cap = SZX_MINCAP;
+  c->sizes = xcalloc(c->cap, sizeof(uint64_t));
+  c->multi = xcalloc(c->cap / 64, sizeof(uint64_t));
+  return c;
+} // szc_init()
+
+void
+szc_free(szcount_t *c)
+{ /* release the counter. */
+  if (!c) return;
+  free(c->sizes);
+  free(c->multi);
+  free(c);
+} // szc_free()
+
+static size_t
+probe(const uint64_t *sizes, size_t cap, size_t size)
+{ /* the slot of size, or the empty slot where it belongs. */
+  size_t i = SZX_HASH(size);
+  for (i &= cap - 1; ; i = (i + 1) & (cap - 1)) {
+    if (sizes[i] == size || sizes[i] == 0) return i;
+  }
+} // probe()
+
+void
+szc_add(szcount_t *c, size_t size)
+{ /* Count a file of size > 0. The caller serialises calls. */
+  if (2 * (c->used + 1) > c->cap) {
+    size_t cap = 2 * c->cap;
+    uint64_t *sizes = xcalloc(cap, sizeof(uint64_t));
+    uint64_t *multi = xcalloc(cap / 64, sizeof(uint64_t));
+    size_t i;
+    for (i = 0; i < c->cap; i++) {
+      if (!c->sizes[i]) continue;
+      size_t j = probe(sizes, cap, c->sizes[i]);
+      sizes[j] = c->sizes[i];
+      if ((c->multi[i / 64] >> (i % 64)) & 1) multi[j / 64] |= 1ULL << (j % 64);
+    }
+    free(c->sizes);
+    free(c->multi);
+    c->sizes = sizes;
+    c->multi = multi;
+    c->cap = cap;
+  }
+  size_t i = probe(c->sizes, c->cap, size);
+  if (c->sizes[i]) {
+    c->multi[i / 64] |= 1ULL << (i % 64);
+  } else {
+    c->sizes[i] = size;
+    c->used++;
+  }
+} // szc_add()
+
+int
+szc_multi(const szcount_t *c, size_t size)
+{ /* Non-zero if more than one file had this size. Safe to call from
+   * several threads at once as long as none is adding.
+  */
+  if (size == 0) return 0;
+  size_t i = probe(c->sizes, c->cap, size);
+  return c->sizes[i] && ((c->multi[i / 64] >> (i % 64)) & 1);
+} // szc_multi()
+
+size_t
+szc_bytes(const szcount_t *c)
+{ /* memory held by the counter. */
+  return c->cap * sizeof(uint64_t) + c->cap / 8;
+} // szc_bytes()
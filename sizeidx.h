@@ -0,0 +1,95 @@
+/*    sizeidx.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of sizeidx.[h|c] is to find, while the tree is still
+ * being read, which files share their size with some other file. It is
+ * an open addressing hash table keyed on file size. The first file of a
+ * size is held in its slot as a pending record; szx_add() hands it back
+ * when a second file of that size turns up, so that only files which
+ * might be duplicates need be kept anywhere else. Size 0 marks an empty
+ * slot, so empty files must not be added.
+ * A szcount_t is the same idea cut down to 8 bytes and a bit per slot;
+ * it only says whether a size has been seen more than once, which is
+ * all a first pass over the tree needs to record.
+ * */
+
+#ifndef _SIZEIDX_H
+#define _SIZEIDX_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "str.h"
+
+typedef struct szrec_t {  // what is kept of a file of unique size.
+  uint32_t file;          // path store handle.
+  ino_t inode;
+} szrec_t;
+
+typedef struct szslot_t {
+  size_t size;
+  szrec_t first;
+  uint32_t count;         // files of this size, saturates.
+} szslot_t;
+
+typedef struct szcount_t { // sizes only, for a --low-memory first pass.
+  uint64_t *sizes;        // open addressing, 0 is empty.
+  uint64_t *multi;        // bitmap, the size in that slot is repeated.
+  size_t cap;             // a power of 2.
+  size_t used;
+} szcount_t;
+
+typedef struct sizeidx_t {
+  szslot_t *slots;
+  size_t cap;             // a power of 2.
+  size_t used;
+  size_t singles;         // slots still holding a pending record.
+} sizeidx_t;
+
+sizeidx_t
+*szx_init(void);
+
+void
+szx_free(sizeidx_t *x);
+
+uint32_t
+szx_add(sizeidx_t *x, size_t size, const szrec_t *rec, szrec_t *first);
+
+void
+szx_report(const sizeidx_t *x, size_t kept);
+
+szcount_t
+*szc_init(void);
+
+void
+szc_free(szcount_t *c);
+
+void
+szc_add(szcount_t *c, size_t size);
+
+int
+szc_multi(const szcount_t *c, size_t size);
+
+size_t
+szc_bytes(const szcount_t *c);
+
+#endif
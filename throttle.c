@@ -0,0 +1,136 @@
+/*    throttle.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of throttle.[h|c] is to hold down the rate of reads and
+ * stats, and the priority of the process. See throttle.h.
+ * */
+
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/ioprio.h>
+#include "str.h"
+#include "throttle.h"
+
+static double
+elapsed(const struct timespec *from, const struct timespec *to);
+
+tb_t
+*tb_init(double rate)
+{ /* A bucket for rate tokens a second, starting full. */
+  tb_t *tb = xcalloc(1, sizeof(struct tb_t));
+  pthread_mutex_init(&tb->lock, NULL);
+  tb->rate = rate;
+  tb->burst = rate;
+  tb->tokens = rate;
+  clock_gettime(CLOCK_MONOTONIC, &tb->last);
+  return tb;
+} // tb_init()
+
+void
+tb_free(tb_t *tb)
+{ /* tb may be NULL. */
+  if (!tb) return;
+  pthread_mutex_destroy(&tb->lock);
+  free(tb);
+} // tb_free()
+
+void
+tb_take(tb_t *tb, double n)
+{ /* Take n tokens, sleeping until the bucket would have had them. The
+   * tokens are taken at once, even into debt, so that a request bigger
+   * than the bucket holds still goes through, and the threads queue in
+   * the order they came. A NULL bucket is no limit.
+  */
+  if (!tb) return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pthread_mutex_lock(&tb->lock);
+  tb->tokens += elapsed(&tb->last, &now) * tb->rate;
+  if (tb->tokens > tb->burst) tb->tokens = tb->burst;
+  tb->last = now;
+  tb->tokens -= n;
+  tb->taken += n;
+  double wait = (tb->tokens < 0) ? -tb->tokens / tb->rate : 0;
+  if (wait > 0) {
+    tb->delayed += n;
+    tb->waited += wait;
+  }
+  pthread_mutex_unlock(&tb->lock);
+  if (wait > 0) {
+    struct timespec ts;
+    ts.tv_sec = wait;
+    ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) ;
+  }
+} // tb_take()
+
+void
+tb_report(const tb_t *tb, const char *what, const char *unit)
+{ /* What the bucket has held back, to stderr. */
+  if (!tb) return;
+  fprintf(stderr, "%s limit %.0f %s/s: %llu %s, %llu of them delayed, "
+          "%.1f s waited over all threads.\n", what, tb->rate, unit,
+          (unsigned long long)tb->taken, unit,
+          (unsigned long long)tb->delayed, tb->waited);
+} // tb_report()
+
+int
+set_ioprio(const char *how)
+{ /* Set the io priority of the process from how, "idle", or "be" with
+   * an optional ":N", N from 0, the highest, to 7. Returns 0, or -1
+   * with errno set if how is not understood or the kernel refuses.
+  */
+  int class, level = 4;
+  if (strcmp(how, "idle") == 0) {
+    class = IOPRIO_CLASS_IDLE;
+    level = 0;
+  } else if (strncmp(how, "be", 2) == 0 && (!how[2] || how[2] == ':')) {
+    class = IOPRIO_CLASS_BE;
+    if (how[2]) {
+      char *end;
+      level = strtol(how + 3, &end, 10);
+      if (*end || end == how + 3 || level < 0 || level > 7) {
+        errno = EINVAL;
+        return -1;
+      }
+    }
+  } else {
+    errno = EINVAL;
+    return -1;
+  }
+  return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                 IOPRIO_PRIO_VALUE(class, level));
+} // set_ioprio()
+
+int
+set_nice(int inc)
+{ /* lower the cpu priority of the process by inc. */
+  errno = 0;
+  int res = nice(inc);
+  return (res == -1 && errno) ? -1 : 0;
+} // set_nice()
+
+static double
+elapsed(const struct timespec *from, const struct timespec *to)
+{ /* seconds from from to to. */
+  return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+} // elapsed()
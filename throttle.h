@@ -0,0 +1,72 @@
+/*    throttle.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of throttle.[h|c] is to let filedups run on a busy host
+ * without taking all of its disks or cpu. A tb_t is a token bucket
+ * shared by all threads: each read or stat takes tokens for what it
+ * is about to do and sleeps for as long as the bucket is in debt, so
+ * the long run rate is held to the one given while a short burst, up
+ * to a second's worth, goes through at once. What was held back, and
+ * for how long, is kept for a report. set_ioprio() and set_nice()
+ * lower the standing of the whole process; they are to be called
+ * before any thread is started, which then inherits them.
+ * */
+
+#ifndef _THROTTLE_H
+#define _THROTTLE_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct tb_t {
+  pthread_mutex_t lock;
+  double rate;          // tokens a second.
+  double burst;         // the most tokens held.
+  double tokens;        // below 0 when in debt.
+  struct timespec last; // when tokens was brought up to date.
+  uint64_t taken;       // tokens taken in all,
+  uint64_t delayed;     // those which had to be waited for,
+  double waited;        // and the seconds slept, summed over threads.
+} tb_t;
+
+tb_t
+*tb_init(double rate);
+
+void
+tb_free(tb_t *tb);
+
+void
+tb_take(tb_t *tb, double n);
+
+void
+tb_report(const tb_t *tb, const char *what, const char *unit);
+
+int
+set_ioprio(const char *how);
+
+int
+set_nice(int inc);
+
+#endif
@@ -0,0 +1,179 @@
+/*    uring.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of uring.[h|c] is to provide a bare io_uring(7) ring.
+ * See uring.h.
+ * */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "uring.h"
+
+struct uring_t {
+  int fd;
+  unsigned entries;
+  // submission queue
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sqe_tail;  // sqes handed out but not yet submitted end here.
+  // completion queue
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  // mappings
+  void *sq_ring;
+  size_t sq_ring_sz;
+  void *cq_ring;
+  size_t cq_ring_sz;
+  size_t sqes_sz;
+};
+
+uring_t
+*uring_init(unsigned entries)
+{ /* Make a ring of entries submission slots, or return NULL if the
+   * kernel can not provide one.
+  */
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd == -1) return NULL;
+  uring_t *r = xcalloc(1, sizeof(struct uring_t));
+  r->fd = fd;
+  r->entries = p.sq_entries;
+  r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_ring_sz = p.cq_off.cqes + p.cq_entries
+                  * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_ring_sz > r->sq_ring_sz) r->sq_ring_sz = r->cq_ring_sz;
+    r->cq_ring_sz = r->sq_ring_sz;
+  }
+  r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->sq_ring == MAP_FAILED) goto fail;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_ring = r->sq_ring;
+  } else {
+    r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (r->cq_ring == MAP_FAILED) goto fail;
+  }
+  r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) goto fail;
+  char *sq = r->sq_ring;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->sqe_tail = *r->sq_tail;
+  char *cq = r->cq_ring;
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return r;
+fail:
+  uring_free(r);
+  return NULL;
+} // uring_init()
+
+void
+uring_free(uring_t *r)
+{ /* unmap and close the ring. */
+  if (!r) return;
+  if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_sz);
+  if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+    munmap(r->cq_ring, r->cq_ring_sz);
+  if (r->sq_ring && r->sq_ring != MAP_FAILED)
+    munmap(r->sq_ring, r->sq_ring_sz);
+  close(r->fd);
+  free(r);
+} // uring_free()
+
+unsigned
+uring_space(uring_t *r)
+{ /* number of sqes that may be taken before the next submit. */
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  return r->entries - (r->sqe_tail - head);
+} // uring_space()
+
+struct io_uring_sqe
+*uring_get_sqe(uring_t *r)
+{ /* a zeroed sqe to fill in, or NULL if the queue is full. */
+  if (!uring_space(r)) return NULL;
+  unsigned idx = r->sqe_tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  r->sq_array[idx] = idx;
+  r->sqe_tail++;
+  return sqe;
+} // uring_get_sqe()
+
+int
+uring_submit(uring_t *r, unsigned wait_nr)
+{ /* Pass the prepared sqes to the kernel and wait for at least wait_nr
+   * completions. Sqes the kernel does not take stay queued and go with
+   * the next call; it then does not wait, so the caller is to reap what
+   * has completed and call again. Returns the number submitted, 0 if
+   * the kernel is short of resources or completion slots, or -1 with
+   * errno set.
+  */
+  __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  unsigned n = r->sqe_tail - head;  // all not yet taken by the kernel.
+  unsigned flags = (wait_nr) ? IORING_ENTER_GETEVENTS : 0;
+  int res;
+  do {
+    res = syscall(__NR_io_uring_enter, r->fd, n, wait_nr, flags, NULL, 0);
+  } while (res == -1 && errno == EINTR);
+  if (res == -1 && (errno == EAGAIN || errno == EBUSY)) res = 0;
+  return res;
+} // uring_submit()
+
+struct io_uring_cqe
+*uring_peek_cqe(uring_t *r)
+{ /* the oldest unseen completion, or NULL if there is none. */
+  unsigned head = *r->cq_head;
+  unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+  if (head == tail) return NULL;
+  return &r->cqes[head & *r->cq_mask];
+} // uring_peek_cqe()
+
+void
+uring_cqe_seen(uring_t *r)
+{ /* release the completion returned by uring_peek_cqe(). */
+  __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+} // uring_cqe_seen()
+
+int
+uring_register_buffers(uring_t *r, const struct iovec *iov, unsigned n)
+{ /* Pin n buffers for IORING_OP_READ_FIXED, which then names them by
+   * their index in iov. Returns 0, or -1 with errno set, eg when the
+   * buffers would be over RLIMIT_MEMLOCK.
+  */
+  return syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS,
+                 iov, n);
+} // uring_register_buffers()
@@ -0,0 +1,64 @@
+/*    uring.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of uring.[h|c] is to provide a bare io_uring(7) ring,
+ * set up with the raw system calls so that liburing is not needed.
+ * uring_init() returns NULL on kernels without io_uring and callers
+ * are expected to fall back to ordinary synchronous calls.
+ * */
+
+#ifndef _URING_H
+#define _URING_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "str.h"
+
+typedef struct uring_t uring_t;
+
+uring_t
+*uring_init(unsigned entries);
+
+void
+uring_free(uring_t *r);
+
+struct io_uring_sqe
+*uring_get_sqe(uring_t *r);
+
+int
+uring_submit(uring_t *r, unsigned wait_nr);
+
+struct io_uring_cqe
+*uring_peek_cqe(uring_t *r);
+
+void
+uring_cqe_seen(uring_t *r);
+
+unsigned
+uring_space(uring_t *r);
+
+int
+uring_register_buffers(uring_t *r, const struct iovec *iov, unsigned n);
+
+#endif
@@ -0,0 +1,456 @@
+/*    walk.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of walk.[h|c] is to traverse a directory tree using a
+ * pool of threads. See walk.h.
+ * */
+
+#include "walk.h"
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#define DENTS_BUFSIZE (256 * 1024) // getdents64() batch, per worker.
+
+struct linux_dirent64 {
+  ino64_t        d_ino;
+  off64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+typedef struct wnode_t wnode_t;
+
+typedef struct went_t {
+  size_t name;  // offset of the d_name in the owning node's names.
+  wnode_t *sub; // the directory node if this entry is a dir.
+  wstat_t st;   // valid for files when the walk has WALK_STAT.
+} went_t;
+
+struct wnode_t {
+  char *path;   // full path of this dir.
+  char *names;  // d_names of the entries as C strings.
+  size_t nlen;
+  size_t ncap;
+  went_t *ents; // entries in the order readdir() gave them.
+  int count;
+  int cap;
+};
+
+typedef struct wdeque_t {
+  pthread_mutex_t lock;
+  wnode_t **items;  // items[head] .. items[tail-1] are queued.
+  int head;
+  int tail;
+  int cap;
+} wdeque_t;
+
+struct walk_t {
+  int nthreads;
+  int flags;
+  walk_exclude_f exclude;
+  walk_keep_f keep; // NULL keeps every file.
+  tb_t *throttle;   // a token for each fstatat(), NULL for no limit.
+  void *arg;       // for exclude() and keep().
+  wdeque_t *deques;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+  long outstanding; // dirs queued or being read, atomic access only.
+  int idle;         // workers waiting on idle_cond, atomic access only.
+};
+
+typedef struct wctx_t {
+  walk_t *w;
+  int id;
+} wctx_t;
+
+typedef struct wlazy_t {  // a dir as seen by replay().
+  struct wlazy_t *up;
+  const char *name;
+  unsigned handle;        // as given by the caller's walk_dir_f.
+  int known;              // handle is valid.
+} wlazy_t;
+
+static wnode_t
+*new_node(const char *path);
+static went_t
+*node_add(wnode_t *n, const char *dname, wnode_t *sub);
+static void
+deque_push(wdeque_t *dq, wnode_t *n);
+static wnode_t
+*deque_pop(wdeque_t *dq);
+static wnode_t
+*deque_steal(wdeque_t *dq);
+static void
+*worker(void *p);
+static void
+read_node(walk_t *w, int id, wnode_t *n, char *buf);
+static void
+queue_dir(walk_t *w, int id, wnode_t *n, const char *dname);
+static unsigned
+dir_handle(wlazy_t *lz, walk_dir_f dir, void *arg);
+static void
+replay(walk_t *w, wnode_t *n, wlazy_t *lz, walk_dir_f dir,
+       walk_file_f file, void *arg);
+
+walk_t
+*walk_init(int nthreads, int flags, walk_exclude_f exclude, void *arg)
+{ /* Set up a walker using nthreads workers. Each worker holds at most
+   * one directory open at a time, so the thread count is also the
+   * descriptor budget of the walk; it is clamped to fit RLIMIT_NOFILE
+   * leaving room for the rest of the program.
+  */
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+  {
+    int budget = (int)rl.rlim_cur - 32;
+    if (budget < 1) budget = 1;
+    if (nthreads > budget) nthreads = budget;
+  }
+  if (nthreads < 1) nthreads = 1;
+  walk_t *w = xcalloc(1, sizeof(struct walk_t));
+  w->nthreads = nthreads;
+  w->flags = flags;
+  w->exclude = exclude;
+  w->arg = arg;
+  w->deques = xcalloc(nthreads, sizeof(struct wdeque_t));
+  int i;
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_init(&w->deques[i].lock, NULL);
+  }
+  pthread_mutex_init(&w->idle_lock, NULL);
+  pthread_cond_init(&w->idle_cond, NULL);
+  return w;
+} // walk_init()
+
+void
+walk_free(walk_t *w)
+{ /* release the walker. */
+  if (!w) return;
+  int i;
+  for (i = 0; i < w->nthreads; i++) {
+    pthread_mutex_destroy(&w->deques[i].lock);
+    free(w->deques[i].items);
+  }
+  free(w->deques);
+  pthread_mutex_destroy(&w->idle_lock);
+  pthread_cond_destroy(&w->idle_cond);
+  free(w);
+} // walk_free()
+
+void
+walk_set_keep(walk_t *w, walk_keep_f keep)
+{ /* Have the workers drop files that keep() rejects, so that neither
+   * the walker nor the caller need hold their names. Only used with
+   * WALK_STAT, which keep() needs.
+  */
+  if (w->flags & WALK_STAT) w->keep = keep;
+} // walk_set_keep()
+
+void
+walk_set_throttle(walk_t *w, tb_t *tb)
+{ /* Have each fstatat() of the workers take a token from tb first. */
+  w->throttle = tb;
+} // walk_set_throttle()
+
+int
+walk_default_threads(void)
+{ /* one walker per online cpu. */
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int)n : 1;
+} // walk_default_threads()
+
+void
+walk_run(walk_t *w, const char *root, walk_dir_f dir, walk_file_f file,
+         void *arg)
+{ /* Traverse the tree at root, then hand every regular file found to
+   * file(), together with the handle that dir() gave for the directory
+   * holding it. A dir is passed to dir() only if there is a file under
+   * it, root first with a parent of WALK_ROOT. These calls happen on
+   * the calling thread only.
+  */
+  wnode_t *top = new_node(root);
+  w->outstanding = 1;
+  deque_push(&w->deques[0], top);
+  pthread_t *tids = xcalloc(w->nthreads, sizeof(pthread_t));
+  wctx_t *ctx = xcalloc(w->nthreads, sizeof(struct wctx_t));
+  int i;
+  for (i = 0; i < w->nthreads; i++) {
+    ctx[i].w = w;
+    ctx[i].id = i;
+    if (pthread_create(&tids[i], NULL, worker, &ctx[i])) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i = 0; i < w->nthreads; i++) pthread_join(tids[i], NULL);
+  free(ctx);
+  free(tids);
+  wlazy_t lz = { NULL, root, 0, 0 };
+  replay(w, top, &lz, dir, file, arg);
+} // walk_run()
+
+static wnode_t
+*new_node(const char *path)
+{ /* make an empty directory node. */
+  wnode_t *n = xcalloc(1, sizeof(struct wnode_t));
+  n->path = xstrdup((char *)path);
+  return n;
+} // new_node()
+
+static went_t
+*node_add(wnode_t *n, const char *dname, wnode_t *sub)
+{ /* record an entry of this dir. */
+  size_t len = strlen(dname) + 1;
+  if (n->nlen + len > n->ncap) {
+    n->ncap = (n->ncap) ? 2 * n->ncap : 256;
+    while (n->nlen + len > n->ncap) n->ncap *= 2;
+    n->names = realloc(n->names, n->ncap);
+    if (!n->names) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (n->count == n->cap) {
+    n->cap = (n->cap) ? 2 * n->cap : 16;
+    n->ents = realloc(n->ents, n->cap * sizeof(struct went_t));
+    if (!n->ents) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(n->names + n->nlen, dname, len);
+  n->ents[n->count].name = n->nlen;
+  n->ents[n->count].sub = sub;
+  n->count++;
+  n->nlen += len;
+  return &n->ents[n->count - 1];
+} // node_add()
+
+static void
+deque_push(wdeque_t *dq, wnode_t *n)
+{ /* the owner pushes at the tail. */
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail == dq->cap) {
+    if (dq->head) { // reclaim space stolen from the front.
+      memmove(dq->items, dq->items + dq->head,
+              (dq->tail - dq->head) * sizeof(wnode_t *));
+      dq->tail -= dq->head;
+      dq->head = 0;
+    }
+    if (dq->tail == dq->cap) {
+      dq->cap = (dq->cap) ? 2 * dq->cap : 64;
+      dq->items = realloc(dq->items, dq->cap * sizeof(wnode_t *));
+      if (!dq->items) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  dq->items[dq->tail++] = n;
+  pthread_mutex_unlock(&dq->lock);
+} // deque_push()
+
+static wnode_t
+*deque_pop(wdeque_t *dq)
+{ /* the owner takes the most recent dir, keeping its walk depth first. */
+  wnode_t *n = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail > dq->head) n = dq->items[--dq->tail];
+  if (dq->tail == dq->head) dq->head = dq->tail = 0;
+  pthread_mutex_unlock(&dq->lock);
+  return n;
+} // deque_pop()
+
+static wnode_t
+*deque_steal(wdeque_t *dq)
+{ /* thieves take the oldest dir, which is the likeliest to be big. */
+  wnode_t *n = NULL;
+  if (pthread_mutex_trylock(&dq->lock)) return NULL;
+  if (dq->tail > dq->head) n = dq->items[dq->head++];
+  if (dq->tail == dq->head) dq->head = dq->tail = 0;
+  pthread_mutex_unlock(&dq->lock);
+  return n;
+} // deque_steal()
+
+static void
+*worker(void *p)
+{ /* Read dirs from our own deque, else steal from the others, until no
+   * dir is queued or being read anywhere.
+  */
+  wctx_t *ctx = p;
+  walk_t *w = ctx->w;
+  int id = ctx->id;
+  char *buf = xmalloc(DENTS_BUFSIZE);
+  while (1) {
+    wnode_t *n = deque_pop(&w->deques[id]);
+    int i;
+    for (i = 1; !n && i < w->nthreads; i++) {
+      n = deque_steal(&w->deques[(id + i) % w->nthreads]);
+    }
+    if (n) {
+      read_node(w, id, n, buf);
+      if (__atomic_sub_fetch(&w->outstanding, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&w->idle_lock);
+        pthread_cond_broadcast(&w->idle_cond);
+        pthread_mutex_unlock(&w->idle_lock);
+      }
+      continue;
+    }
+    if (__atomic_load_n(&w->outstanding, __ATOMIC_SEQ_CST) == 0) break;
+    /* Nothing to steal just now, but others are still reading dirs
+     * which may yield more work. The timeout covers a missed wakeup.
+    */
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&w->idle_lock);
+    __atomic_add_fetch(&w->idle, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->outstanding, __ATOMIC_SEQ_CST)) {
+      pthread_cond_timedwait(&w->idle_cond, &w->idle_lock, &ts);
+    }
+    __atomic_sub_fetch(&w->idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&w->idle_lock);
+  } // while()
+  free(buf);
+  return NULL;
+} // worker()
+
+static void
+read_node(walk_t *w, int id, wnode_t *n, char *buf)
+{ /* Record the eligible entries of one dir, queueing its subdirs. */
+  int dfd = open(n->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dfd == -1) {
+    perror(n->path);
+    exit(EXIT_FAILURE);
+  }
+  long nread;
+  while ((nread = syscall(SYS_getdents64, dfd, buf, DENTS_BUFSIZE)) > 0) {
+    long pos;
+    for (pos = 0; pos < nread; ) {
+      struct linux_dirent64 *de = (struct linux_dirent64 *)(buf + pos);
+      pos += de->d_reclen;
+      if (strcmp(de->d_name, ".") == 0 ) continue;
+      if (strcmp(de->d_name, "..") == 0) continue;
+      if (w->exclude(de->d_name, w->arg)) continue;
+      unsigned char type = de->d_type;
+      struct stat sb;
+      int statted = 0;
+      if (type == DT_UNKNOWN ||
+          (type == DT_REG && (w->flags & WALK_STAT))) {
+        tb_take(w->throttle, 1);
+        if (fstatat(dfd, de->d_name, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+          fprintf(stderr, "File dissappeared: %s/%s\n", n->path,
+                  de->d_name);
+          continue;
+        }
+        statted = 1;
+        if (S_ISDIR(sb.st_mode)) type = DT_DIR;
+        else if (S_ISREG(sb.st_mode)) type = DT_REG;
+        else continue;
+      }
+      went_t *ent;
+      wstat_t st;
+      switch (type) {
+      case DT_DIR:
+        queue_dir(w, id, n, de->d_name);
+        break;
+      case DT_REG:
+        if (statted) {
+          st.size = sb.st_size;
+          st.inode = sb.st_ino;
+        }
+        if (w->keep && !w->keep(de->d_name, &st, w->arg)) break;
+        ent = node_add(n, de->d_name, NULL);
+        if (statted) ent->st = st;
+        break;
+      default:
+        break;  // no interest in anything except regular files and dirs.
+      } // switch()
+    } // for()
+  } // while()
+  if (nread == -1) {
+    perror(n->path);
+    exit(EXIT_FAILURE);
+  }
+  close(dfd);
+} // read_node()
+
+static void
+queue_dir(walk_t *w, int id, wnode_t *n, const char *dname)
+{ /* add a subdir to n and make it available to all workers. */
+  char joinbuf[PATH_MAX];
+  strcpy(joinbuf, n->path);
+  strcat(joinbuf, "/");
+  strcat(joinbuf, dname);
+  wnode_t *sub = new_node(joinbuf);
+  node_add(n, dname, sub);
+  __atomic_add_fetch(&w->outstanding, 1, __ATOMIC_SEQ_CST);
+  deque_push(&w->deques[id], sub);
+  if (__atomic_load_n(&w->idle, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&w->idle_lock);
+    pthread_cond_signal(&w->idle_cond);
+    pthread_mutex_unlock(&w->idle_lock);
+  }
+} // queue_dir()
+
+static unsigned
+dir_handle(wlazy_t *lz, walk_dir_f dir, void *arg)
+{ /* Register the dir, and any parents not yet registered, the first
+   * time a file is found under it.
+  */
+  if (!lz->known) {
+    unsigned parent = (lz->up) ? dir_handle(lz->up, dir, arg) : WALK_ROOT;
+    lz->handle = dir(parent, lz->name, arg);
+    lz->known = 1;
+  }
+  return lz->handle;
+} // dir_handle()
+
+static void
+replay(walk_t *w, wnode_t *n, wlazy_t *lz, walk_dir_f dir,
+       walk_file_f file, void *arg)
+{ /* Emit the files under n depth first, in the order readdir() listed
+   * them, exactly as a single threaded recursion would have. Nodes are
+   * freed as they are done with.
+  */
+  int i;
+  for (i = 0; i < n->count; i++) {
+    const char *name = n->names + n->ents[i].name;
+    if (n->ents[i].sub) {
+      wlazy_t sub = { lz, name, 0, 0 };
+      replay(w, n->ents[i].sub, &sub, dir, file, arg);
+    } else {
+      file(dir_handle(lz, dir, arg), name,
+           (w->flags & WALK_STAT) ? &n->ents[i].st : NULL, arg);
+    }
+  } // for()
+  free(n->path);
+  free(n->names);
+  free(n->ents);
+  free(n);
+} // replay()
@@ -0,0 +1,96 @@
+/*    walk.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of walk.[h|c] is to traverse a directory tree using a
+ * pool of threads. Each directory is a work item; workers keep their
+ * own deque of directories and steal from each other when they run
+ * dry. The entries found are kept in a tree of directory nodes which
+ * is replayed in readdir() order once all workers are finished, so
+ * the caller sees the same sequence of paths whatever the number of
+ * threads used. Each dir is reported once, ahead of its files, so the
+ * caller can keep a table of dirs rather than a full path per file.
+ * Dirs are read in large batches with getdents64(2). With WALK_STAT the
+ * size and inode of each regular file are taken by fstatat(2) relative
+ * to the open dir, so the kernel need not resolve the full path again.
+ * An entry whose d_type is DT_UNKNOWN, as some XFS, NFS and FUSE mounts
+ * give, is always typed by fstatat(2). A walk_keep_f set by
+ * walk_set_keep() lets the workers drop files on their size and inode
+ * before anything is stored for them. walk_set_throttle() holds the
+ * fstatat(2) calls to a rate, see throttle.h.
+ * */
+
+#ifndef _WALK_H
+#define _WALK_H
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "str.h"
+#include "throttle.h"
+
+#define WALK_STAT 1 // flag, fstatat() regular files as they are found.
+#define WALK_ROOT ((unsigned)-1)  // parent handle of the top dir.
+
+typedef struct walk_t walk_t;
+
+typedef struct wstat_t {
+  size_t size;
+  ino_t inode;
+} wstat_t;
+
+/* Returns non-zero if the d_name is to be ignored. */
+typedef int (*walk_exclude_f)(const char *dname, void *arg);
+/* Receives each dir holding files, returns the handle to give its
+ * files and subdirs. The name of the top dir is the path walked. */
+typedef unsigned (*walk_dir_f)(unsigned parent, const char *name,
+                               void *arg);
+/* Receives each regular file, in traversal order. st is NULL unless
+ * the walker was made with WALK_STAT. */
+typedef void (*walk_file_f)(unsigned dir, const char *name,
+                            const wstat_t *st, void *arg);
+/* Called by the workers, concurrently, for each regular file as soon as
+ * it is found; returns non-zero if the file is to be kept for replay.
+ * Needs WALK_STAT. */
+typedef int (*walk_keep_f)(const char *name, const wstat_t *st,
+                           void *arg);
+
+walk_t
+*walk_init(int nthreads, int flags, walk_exclude_f exclude, void *arg);
+
+void
+walk_set_keep(walk_t *w, walk_keep_f keep);
+
+void
+walk_set_throttle(walk_t *w, tb_t *tb);
+
+void
+walk_run(walk_t *w, const char *root, walk_dir_f dir, walk_file_f file,
+         void *arg);
+
+void
+walk_free(walk_t *w);
+
+int
+walk_default_threads(void);
+
+#endif
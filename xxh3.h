@@ -0,0 +1,47 @@
+/*    xxh3.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of xxh3.h is to declare the XXH3 128 bit entry points
+ * built by xxh3_base.c, xxh3_avx2.c and xxh3_avx512.c from the vendored
+ * xxhash.h, each for one instruction set. hash.c picks one at run time.
+ * The state is opaque here so that only those files see xxhash.h.
+ * */
+
+#ifndef _XXH3_H
+#define _XXH3_H
+#include <stddef.h>
+
+typedef struct xxh3_ops_t {
+  const char *isa;
+  void *(*create)(void);
+  void (*release)(void *state);
+  void (*reset)(void *state);
+  void (*update)(void *state, const void *p, size_t n);
+  void (*digest)(const void *state, unsigned char *out); // 16 bytes.
+  void (*copy)(void *to, const void *from);
+} xxh3_ops_t;
+
+extern const xxh3_ops_t xxh3_base;
+#if defined(__x86_64__) || defined(__i386__)
+extern const xxh3_ops_t xxh3_avx2;
+extern const xxh3_ops_t xxh3_avx512;
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+/*    xxh3_avx2.c
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of xxh3_avx2.c is to build XXH3 with AVX2 code, to be
+ * used only when the cpu has it. See xxh3.h.
+ * */
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC target("avx2")
+#include <string.h>
+#define XXH_VECTOR XXH_AVX2
+#define XXH3_OPS xxh3_avx2
+#define XXH3_ISA "avx2"
+#include "xxh3impl.h"
+#endif
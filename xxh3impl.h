@@ -0,0 +1,71 @@
+/*    xxh3impl.h
+ *
+ * Copyright 2020 Robert L (Bob) Parker rlp1938@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* The purpose of xxh3impl.h is to be included once by each of the
+ * xxh3_*.c files, after any target pragma, to build the XXH3 128 bit
+ * functions for that instruction set and gather them as XXH3_OPS. With
+ * XXH_INLINE_ALL everything from xxhash.h is static, so the copies do
+ * not clash.
+ * */
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#include "xxh3.h"
+
+static void
+*x_create(void)
+{ /* a state aligned as XXH3 needs it. */
+  return XXH3_createState();
+} // x_create()
+
+static void
+x_release(void *state)
+{ /* give back a state. */
+  XXH3_freeState(state);
+} // x_release()
+
+static void
+x_reset(void *state)
+{ /* start a new digest. */
+  XXH3_128bits_reset(state);
+} // x_reset()
+
+static void
+x_update(void *state, const void *p, size_t n)
+{ /* add n bytes. */
+  XXH3_128bits_update(state, p, n);
+} // x_update()
+
+static void
+x_digest(const void *state, unsigned char *out)
+{ /* the digest in canonical, big endian, form. */
+  XXH128_canonical_t c;
+  XXH128_canonicalFromHash(&c, XXH3_128bits_digest(state));
+  memcpy(out, c.digest, 16);
+} // x_digest()
+
+static void
+x_copy(void *to, const void *from)
+{ /* to carries on from where from is. */
+  XXH3_copyState(to, from);
+} // x_copy()
+
+const xxh3_ops_t XXH3_OPS = { XXH3_ISA, x_create, x_release, x_reset,
+                              x_update, x_digest, x_copy };